@@ -0,0 +1,104 @@
+#include "bench.h"
+
+#ifdef QUICKRDR_BENCHMARK
+
+#include <sys/lcd.h>
+#include <sys/timers.h>
+#include <graphx.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "textmode.h"
+
+#define BENCH_TIMER 1
+// like dbg_printf(), but also available in release builds
+#define BENCH_OUT ((char *)0xFB0000)
+
+static uint32_t crc_table[256];
+static bool pending;
+static uint8_t pending_key;
+static uint32_t start;
+static unsigned int sample;
+
+void bench_begin(void)
+{
+    for (unsigned int i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = crc & 1 ? 0xEDB88320 ^ (crc >> 1) : crc >> 1;
+        }
+        crc_table[i] = crc;
+    }
+    timer_Set(BENCH_TIMER, 0);
+    timer_Enable(BENCH_TIMER, TIMER_CPU, TIMER_NOINT, TIMER_UP);
+    strcpy(BENCH_OUT, "QRBENCH begin\n");
+}
+
+void bench_end(void)
+{
+    timer_Disable(BENCH_TIMER);
+    strcpy(BENCH_OUT, "QRBENCH end\n");
+}
+
+void bench_key(uint8_t key)
+{
+    if (!pending)
+    {
+        start = timer_Get(BENCH_TIMER);
+        pending = true;
+    }
+    pending_key = key;
+}
+
+// standard CRC-32, the same as zlib.crc32()
+static uint32_t crc32(const uint8_t *data, size_t size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    while (size--)
+    {
+        crc = crc_table[(uint8_t)crc ^ *data++] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// the TI-OS sprintf() has no 32-bit formats
+static char *put_uint32(char *out, uint32_t value, uint8_t base, uint8_t digits)
+{
+    char tmp[10];
+    uint8_t count = 0;
+    do
+    {
+        tmp[count++] = "0123456789abcdef"[value % base];
+        value /= base;
+    } while (value || count < digits);
+    while (count)
+    {
+        *out++ = tmp[--count];
+    }
+    return out;
+}
+
+void bench_frame(bool settled, uint8_t state, uint24_t page)
+{
+    if (!pending || !settled)
+    {
+        return;
+    }
+    uint32_t cycles = timer_Get(BENCH_TIMER) - start;
+    pending = false;
+    const uint8_t *screen = (const uint8_t *)lcd_UpBase;
+    size_t size = textmode_active() ? textmode_buffer_size() : GFX_LCD_WIDTH * GFX_LCD_HEIGHT;
+    char line[64];
+    char *out = line + sprintf(line, "QRBENCH %u %u %u %u ", sample++, pending_key, state, page);
+    out = put_uint32(out, cycles, 10, 1);
+    *out++ = ' ';
+    out = put_uint32(out, crc32(screen, size), 16, 8);
+    *out++ = '\n';
+    *out = '\0';
+    strcpy(BENCH_OUT, line);
+}
+
+#endif
@@ -0,0 +1,31 @@
+// Page-turn benchmark hooks, only compiled in with `make BENCHMARK=1`
+// (see tools/pagebench)
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef QUICKRDR_BENCHMARK
+
+void bench_begin(void);
+void bench_end(void);
+/**
+ * Starts timing at a key press, unless an earlier press has not settled yet.
+ */
+void bench_key(uint8_t key);
+/**
+ * Called after every frame is shown. Once the frame is `settled` (nothing is
+ * left to load or draw) the CPU cycles since the key press and a CRC of the
+ * screen are written to the CEmu debug console as
+ * `QRBENCH <sample> <key> <state> <page> <cycles> <crc>`.
+ */
+void bench_frame(bool settled, uint8_t state, uint24_t page);
+
+#else
+
+#define bench_begin()
+#define bench_end()
+#define bench_key(key)
+#define bench_frame(settled, state, page)
+
+#endif
@@ -1,4 +1,4 @@
-unsigned char quickrdr_palette[14] =
+unsigned char quickrdr_palette[18] =
 {
     0xbd, 0xf7, /*   0: rgb(239, 239, 239) */
     0x00, 0x00, /*   1: rgb(  0,   0,   0) */
@@ -7,4 +7,6 @@ unsigned char quickrdr_palette[14] =
     0x98, 0x99, /*   4: rgb( 49, 101, 197) */
     0xc6, 0x18, /*   5: rgb( 49,  49,  49) */
     0xdb, 0x4a, /*   6: rgb(148, 178, 222) */
+    0xb5, 0xd6, /*   7: rgb(173, 174, 173) */
+    0xce, 0x39, /*   8: rgb(115, 113, 115) */
 };
@@ -5,8 +5,8 @@
 extern "C" {
 #endif
 
-#define sizeof_quickrdr_palette 14
-extern unsigned char quickrdr_palette[14];
+#define sizeof_quickrdr_palette 18
+extern unsigned char quickrdr_palette[18];
 
 #ifdef __cplusplus
 }
@@ -3,14 +3,21 @@
 #include <sys/lcd.h>
 #include <sys/rtc.h>
 #include <sys/power.h>
+#include <sys/timers.h>
 
 #include <fileioc.h>
 #include <graphx.h>
+#include <keypadc.h>
 #include <debug.h>
 
 #include "gfx/gfx.h"
+#include "bench.h"
 #include "quickrdr.h"
+#include "reflow.h"
+#include "scratch.h"
+#include "textmode.h"
 
+#include <stddef.h>
 #include <string.h>
 
 #define COLOR_OFF_WHITE 0
@@ -20,6 +27,8 @@
 #define COLOR_MEDIUM_BLUE 4
 #define COLOR_DARK_GRAY 5
 #define COLOR_ACCENT_BLUE 6
+#define COLOR_LIGHT_GRAY 7
+#define COLOR_GRAY 8
 
 #define COLOR_BAR_BG COLOR_MEDIUM_BLUE
 #define COLOR_BAR_TEXT COLOR_WHITE
@@ -28,10 +37,19 @@
 #define COLOR_HIGHLIGHT_BG COLOR_ACCENT_BLUE
 #define COLOR_HIGHLIGHT_TEXT COLOR_WHITE
 
-#define getbit(array, index) ((array)[(index) / 8] & (1 << (7 - ((index) % 8))))
+// text mode colors, the grays are a third and two thirds of the way from the
+// background to the text for anti-aliased (2bpp) books
+static const uint8_t text_colors[] = {COLOR_MAIN_BG, COLOR_LIGHT_GRAY, COLOR_GRAY, COLOR_MAIN_TEXT};
 
 #define VERSION "1.0"
 
+// key repeat, in 32768 Hz timer ticks
+#define REPEAT_TIMER 2
+#define REPEAT_DELAY 13107    // 400 ms before the first repeat
+#define REPEAT_INTERVAL 4915  // 150 ms between the first repeats
+#define REPEAT_MIN_INTERVAL 983 // 30 ms at full speed
+#define REPEAT_ACCELERATION 410 // interval shrinks by 12.5 ms per repeat
+
 typedef enum
 {
     state_main = 0,
@@ -56,6 +74,22 @@ typedef enum
 static quickrdr_state_t state = state_main;
 // state_main
 static quickrdr_option_t menu_option = option_open;
+// state_settings
+typedef enum
+{
+    setting_margin = 0,
+    setting_line_spacing,
+    setting_count
+} quickrdr_setting_t;
+static const uint8_t setting_margins[] = {4, 8, 16, 24};
+static const uint8_t setting_line_spacings[] = {0, 2, 4, 6};
+#define setting_choices 4
+static quickrdr_setting_t settings_option = setting_margin;
+// choice of each setting, saved in QKRDCONF
+static uint8_t settings_choice[setting_count] = {
+    [setting_margin] = 1,
+    [setting_line_spacing] = 1,
+};
 // state_book_list
 #define book_list_perpage 6
 static quickrdr_book_t book_list_entries[book_list_perpage];
@@ -66,11 +100,34 @@ static uint8_t book_list_loaded;
 static uint8_t book_list_chosen;
 // state_reading
 static quickrdr_book_handle_t reading_book;
+static char reading_filename[10]; // opened by the first step in state_reading
+static bool reading_resumed;      // by try_continue_book(), the page still has to be checked
+static uint24_t reading_resumed_position;
+static reflow_area_t reading_area;
+static quickrdr_font_t reading_font;
+static bool reading_font_ready; // draw_line() can use textmode_draw_line()
+#define reading_max_lines 64
+typedef struct
+{
+    const uint8_t *data; // points into the archive, or at copy
+    uint8_t *copy;       // only for pages that are split between appvars
+    uint24_t size;
+    uint8_t line_count;
+    uint24_t line_start[reading_max_lines];
+} reading_page_t;
 static uint24_t reading_page;
-static uint8_t *reading_page_data;
-static uint24_t reading_page_size;
+static reading_page_t reading_cur;  // reading_page
+static reading_page_t reading_next; // reading_page + 1, loaded while scrolled
+static uint8_t reading_line;        // first line shown, within reading_page
+static int8_t reading_scroll;       // lines to scroll by in the next partial redraw
+static uint24_t reading_drawn_page; // page shown in the top bar
+static bool reading_count_stale;     // the page index grew since the top bar was drawn
 // static quickrdr_glyph_t *reading_glyphs; // array
 static uint8_t partial_redraw = 1;
+// key repeat
+static uint8_t repeat_key;
+static uint8_t repeat_count;
+static uint32_t repeat_deadline;
 
 static void get_time(char *output)
 {
@@ -120,9 +177,64 @@ static inline uint8_t getcsc()
     return key;
 }
 
+// page keys held down skip rendering, scroll keys render incrementally
+static bool page_flipping(void)
+{
+    return repeat_key == sk_Left || repeat_key == sk_Right;
+}
+
+// os_GetCSC() only reports presses, so held page keys are repeated here
+static uint8_t read_key(void)
+{
+    uint8_t key = os_GetCSC();
+    uint32_t now = timer_Get(REPEAT_TIMER);
+    if (key)
+    {
+        repeat_key = state == state_reading && (key == sk_Left || key == sk_Right || key == sk_Up || key == sk_Down) ? key : 0;
+        repeat_count = 0;
+        repeat_deadline = now + REPEAT_DELAY;
+        return key;
+    }
+    if (!repeat_key)
+    {
+        return 0;
+    }
+    kb_Scan();
+    static const kb_lkey_t repeat_lkeys[] = {
+        [sk_Down] = kb_KeyDown,
+        [sk_Left] = kb_KeyLeft,
+        [sk_Right] = kb_KeyRight,
+        [sk_Up] = kb_KeyUp,
+    };
+    if (!kb_IsDown(repeat_lkeys[repeat_key]))
+    {
+        repeat_key = 0;
+        return 0;
+    }
+    if ((int32_t)(now - repeat_deadline) < 0)
+    {
+        return 0;
+    }
+    uint24_t interval = REPEAT_INTERVAL - (uint24_t)repeat_count * REPEAT_ACCELERATION;
+    if (repeat_count * REPEAT_ACCELERATION > REPEAT_INTERVAL - REPEAT_MIN_INTERVAL)
+    {
+        interval = REPEAT_MIN_INTERVAL;
+    }
+    else
+    {
+        repeat_count++;
+    }
+    repeat_deadline += interval;
+    return repeat_key;
+}
+
 // SINGLE LINE ONLY!!!
 static void show_alert(const char *message)
 {
+    if (textmode_active())
+    {
+        textmode_end(COLOR_MAIN_BG);
+    }
     unsigned int width = gfx_GetStringWidth(message);
     if (width > 320)
     {
@@ -144,8 +256,98 @@ typedef struct
 {
     char filename[10];
     uint24_t page;
+    uint24_t position; // stream position of the page, for version 3 and later books
+    // the text area of the page as last shown, for try_continue_book() to show
+    // until the book is open. It is stale unless these still match.
+    uint32_t identity; // quickrdr_book_identity()
+    uint8_t settings[setting_count];
+    uint8_t bpp;
+    uint16_t snapshot_size; // bytes of textmode_snapshot_pack() that follow, 0 for none
 } quickrdr_save_t;
 
+static void load_settings(void)
+{
+    uint8_t var = ti_Open("QKRDCONF", "r");
+    if (var != 0)
+    {
+        uint8_t choice[setting_count];
+        if (ti_Read(choice, sizeof(choice), 1, var) == 1 && choice[setting_margin] < setting_choices && choice[setting_line_spacing] < setting_choices)
+        {
+            memcpy(settings_choice, choice, sizeof(choice));
+        }
+        ti_Close(var);
+    }
+}
+
+static void save_settings(void)
+{
+    uint8_t var = ti_Open("QKRDCONF", "w");
+    if (var != 0)
+    {
+        ti_Write(settings_choice, sizeof(settings_choice), 1, var);
+        ti_SetArchiveStatus(1, var);
+        ti_Close(var);
+    }
+}
+
+static bool reading_reflowed(void)
+{
+    return reading_book->header.version >= 3;
+}
+
+// opens reading_book and, for version 3 and later books, its page index for the current settings
+static uint8_t open_reading_book(const char *filename)
+{
+    reading_book = quickrdr_open_book(filename);
+    if (reading_book == NULL)
+    {
+        return 0;
+    }
+    reflow_settings_t settings = {
+        .margin = setting_margins[settings_choice[setting_margin]],
+        .line_spacing = setting_line_spacings[settings_choice[setting_line_spacing]],
+    };
+    reflow_get_area(reading_book, &settings, &reading_area);
+    reading_font_ready = quickrdr_get_font(reading_book, &reading_font);
+    if (reading_reflowed())
+    {
+        // one index per book and layout: TITLE00 -> TITLEx0, TITLEx1...
+        char index_name[10];
+        strcpy(index_name, filename);
+        size_t length = strlen(index_name);
+        index_name[length - 2] = 'A' + settings_choice[setting_margin] * setting_choices + settings_choice[setting_line_spacing];
+        index_name[length - 1] = '\0';
+        if (!reflow_open(reading_book, &settings, index_name))
+        {
+            quickrdr_close_book(reading_book);
+            reading_book = NULL;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void close_reading_book(void)
+{
+    if (reading_reflowed())
+    {
+        reflow_close();
+    }
+    quickrdr_close_book(reading_book);
+    reading_book = NULL;
+}
+
+// a version 3 or 4 book only knows its pages up to where the index reaches
+static bool reading_has_page(uint24_t page)
+{
+    if (!reading_reflowed())
+    {
+        return page < reading_book->header.page_count;
+    }
+    uint24_t start;
+    return reflow_page_start(page, &start);
+}
+
 static void try_continue_book(void)
 {
     uint8_t var = ti_Open("QKRDSAVE", "r");
@@ -154,41 +356,228 @@ static void try_continue_book(void)
         show_alert("No book found");
         return;
     }
+    // saves from before version 3 books end before `position`, older saves
+    // have no snapshot
     quickrdr_save_t save;
-    if (!ti_Read(&save, sizeof(save), 1, var))
+    save.position = 0;
+    size_t read = ti_Read(&save, 1, sizeof(save), var);
+    if (read < offsetof(quickrdr_save_t, position))
     {
         show_alert("Failed to read save");
         ti_Close(var);
         return;
     }
+    if (read < sizeof(save) || save.snapshot_size > ti_GetSize(var) - sizeof(save))
+    {
+        save.snapshot_size = 0;
+    }
+    strcpy(reading_filename, save.filename);
+    reading_page = save.page;
+    reading_resumed = true;
+    reading_resumed_position = save.position;
+    state = state_reading;
+    // the book is opened by the next step, until then its last page is shown
+    // from the snapshot, which also goes into the cache so that it is not
+    // rendered again
+    if (save.snapshot_size != 0 && memcmp(save.settings, settings_choice, sizeof(save.settings)) == 0 &&
+        save.identity == quickrdr_book_identity(save.filename))
+    {
+        textmode_begin(save.bpp, text_colors);
+        // ti_GetDataPtr() points past what has been read
+        if (textmode_snapshot_unpack(ti_GetDataPtr(var), save.snapshot_size))
+        {
+            textmode_cache_store(reading_page);
+        }
+    }
     ti_Close(var);
-    reading_book = quickrdr_open_book(save.filename);
-    if (reading_book == NULL)
+}
+
+// shown while paginating synchronously
+static void show_paginating(void)
+{
+    gfx_SetColor(COLOR_BAR_BG);
+    gfx_FillRectangle_NoClip(0, 220, 320, 20);
+    gfx_SetTextFGColor(COLOR_BAR_TEXT);
+    gfx_SetTextBGColor(COLOR_BAR_BG);
+    gfx_PrintStringXY("Paginating...", 8, 226);
+    textmode_blit();
+    textmode_pack_rows(&gfx_vbuffer[0][0], 220, 20, COLOR_BAR_BG);
+    textmode_swap();
+}
+
+// the page number of a save is stale if the layout changed since, the saved
+// position is then shown before the index reaches it
+static void check_resumed_page(void)
+{
+    uint24_t start;
+    if (!reading_reflowed() ||
+        (reading_page < reflow_index_count() && reflow_page_start(reading_page, &start) && start == reading_resumed_position))
     {
-        show_alert("Failed to open book");
-        state = state_main;
         return;
     }
-    state = state_reading;
-    reading_page = save.page;
-    reading_page_data = NULL;
+    textmode_cache_forget(reading_page);
+    if (!reflow_resume(reading_resumed_position, &reading_page))
+    {
+        show_paginating();
+        reading_page = reflow_find_page(reading_resumed_position);
+    }
+}
+
+static void unload_page(reading_page_t *page)
+{
+    free(page->copy);
+    page->copy = NULL;
+    page->data = NULL;
+}
+
+// reads a page and indexes its lines, on failure alerts and leaves the book
+static uint8_t load_page(uint24_t page_number, reading_page_t *page)
+{
+    page->copy = NULL;
+    if (reading_reflowed())
+    {
+        // laid out twice, to measure and then into a copy of the right size
+        uint24_t start;
+        uint24_t next;
+        if (!reflow_page_start(page_number, &start) || !reflow_page(start, NULL, &page->size, &next))
+        {
+            show_alert("Failed to lay out page");
+            state = state_main;
+            return 0;
+        }
+        page->copy = malloc(page->size ? page->size : 1);
+        if (page->copy == NULL)
+        {
+            show_alert("Failed to allocate memory");
+            state = state_main;
+            return 0;
+        }
+        reflow_page(start, page->copy, &page->size, &next);
+        page->data = page->copy;
+        page->line_count = quickrdr_index_lines(reading_book, page->data, page->size, page->line_start, reading_max_lines);
+        return 1;
+    }
+    page->data = quickrdr_get_page(reading_book, page_number, &page->size);
+    if (!page->size)
+    {
+        show_alert("Failed to get page size");
+        state = state_main;
+        return 0;
+    }
+    dbg_printf("Page size: %u\n", page->size);
+    if (page->data == NULL)
+    {
+        page->copy = malloc(page->size);
+        if (page->copy == NULL)
+        {
+            show_alert("Failed to allocate memory");
+            state = state_main;
+            return 0;
+        }
+        uint24_t read = quickrdr_read_page(reading_book, page_number, page->copy);
+        if (!read)
+        {
+            show_alert("Failed to read page");
+            unload_page(page);
+            state = state_main;
+            return 0;
+        }
+        page->data = page->copy;
+    }
+    page->line_count = quickrdr_index_lines(reading_book, page->data, page->size, page->line_start, reading_max_lines);
+    return 1;
+}
+
+// makes sure reading_next holds the page after reading_page, returns 0 if there is none
+static uint8_t load_next_page(void)
+{
+    if (reading_next.data != NULL)
+    {
+        return 1;
+    }
+    if (!reading_has_page(reading_page + 1))
+    {
+        return 0;
+    }
+    return load_page(reading_page + 1, &reading_next);
+}
+
+// replaces a detached page (see reflow_resume()) by the index page it starts
+// in, with the same lines in view
+static uint8_t attach_page(bool wait)
+{
+    uint8_t line;
+    if (reading_page < REFLOW_DETACHED_PAGE || !reflow_attach(&reading_page, &line, wait))
+    {
+        return 0;
+    }
+    unload_page(&reading_cur);
+    unload_page(&reading_next);
+    reading_line = line;
+    if (!load_page(reading_page, &reading_cur))
+    {
+        return 0;
+    }
+    if (line != 0)
+    {
+        // the lines past the end of the page
+        load_next_page();
+    }
+    return 1;
+}
+
+// with `snapshot`, also keeps the text area of the page as rendered by a page
+// turn, if it is still in the cache
+static void save_position(bool snapshot)
+{
+    uint8_t var = ti_Open("QKRDSAVE", "w");
+    if (var != 0)
+    {
+        quickrdr_save_t save = {0};
+        quickrdr_get_book_filename(reading_book, save.filename);
+        save.page = reading_page;
+        if (reading_reflowed())
+        {
+            reflow_page_start(reading_page, &save.position);
+        }
+        // packed into gfx_vbuffer, which only holds the bars while reading
+        uint8_t *packed = &gfx_vbuffer[0][0];
+        if (snapshot && textmode_active() && textmode_cache_load(reading_page))
+        {
+            save.identity = quickrdr_book_identity(save.filename);
+            memcpy(save.settings, settings_choice, sizeof(save.settings));
+            save.bpp = textmode_bpp();
+            save.snapshot_size = textmode_snapshot_pack(packed, TEXTMODE_WIDTH * TEXTMODE_HEIGHT);
+        }
+        ti_Write(&save, sizeof(save), 1, var);
+        if (save.snapshot_size != 0 && ti_Write(packed, save.snapshot_size, 1, var) != 1)
+        {
+            // out of memory, keep the position
+            save.snapshot_size = 0;
+            ti_Seek(0, SEEK_SET, var);
+            ti_Write(&save, sizeof(save), 1, var);
+        }
+        ti_SetArchiveStatus(1, var);
+        ti_Close(var);
+    }
 }
 
 static int step(void)
 {
-    uint8_t key = os_GetCSC();
+    uint8_t key = read_key();
+    if (key)
+    {
+        bench_key(key);
+    }
     partial_redraw = 0;
     if (state != state_reading)
     {
-        if (reading_page_data != NULL)
-        {
-            free(reading_page_data);
-            reading_page_data = NULL;
-        }
+        unload_page(&reading_cur);
+        unload_page(&reading_next);
+        reading_line = 0;
         if (reading_book != NULL)
         {
-            quickrdr_close_book(reading_book);
-            reading_book = NULL;
+            close_reading_book();
         }
     }
     if (state == state_main)
@@ -298,7 +687,9 @@ static int step(void)
         {
             if (book_list_count != 0)
             {
+                strcpy(reading_filename, book_list_entries[book_list_chosen].filename);
                 reading_page = 0;
+                reading_resumed = false;
                 state = state_reading;
             }
         }
@@ -352,81 +743,136 @@ static int step(void)
     {
         if (key == sk_Clear)
         {
+            if (reading_cur.data != NULL)
+            {
+                save_position(true);
+            }
             state = state_main;
+            return 1;
         }
         if (reading_book == NULL)
         {
-            reading_book = quickrdr_open_book(book_list_entries[book_list_chosen].filename);
-            if (reading_book == NULL)
+            if (!open_reading_book(reading_filename))
             {
                 show_alert("Failed to open book");
                 state = state_main;
                 return 1;
             }
+            if (reading_resumed)
+            {
+                reading_resumed = false;
+                check_resumed_page();
+            }
+        }
+        if (key == 0 && reading_cur.data != NULL && !page_flipping() && reading_reflowed() && !reflow_index_complete())
+        {
+            // paginate ahead while the reader is idle, the page counter shows the progress
+            reflow_index_step();
+            reading_count_stale = true;
+            if (reading_line == 0 && !attach_page(false) && state != state_reading)
+            {
+                return 1;
+            }
+        }
+        if ((key == sk_Left || (key == sk_Up && reading_line == 0)) && reading_page >= REFLOW_DETACHED_PAGE &&
+            (reading_page == REFLOW_DETACHED_PAGE || !reading_has_page(reading_page - 1)))
+        {
+            // the pages before the first detached one kept are only known to the index
+            show_paginating();
+            if (!attach_page(true))
+            {
+                return 1;
+            }
         }
         if (key == sk_Left)
         {
             if (reading_page > 0)
             {
                 reading_page--;
-                if (reading_page_data != NULL)
-                {
-                    free(reading_page_data);
-                    reading_page_data = NULL;
-                }
+                reading_line = 0;
+                unload_page(&reading_cur);
+                unload_page(&reading_next);
                 partial_redraw = 1;
                 return 1;
             }
         }
         else if (key == sk_Right)
         {
-            if (reading_page < reading_book->header.page_count - 1)
+            if (reading_has_page(reading_page + 1))
             {
                 reading_page++;
-                if (reading_page_data != NULL)
-                {
-                    free(reading_page_data);
-                    reading_page_data = NULL;
-                }
+                reading_line = 0;
+                unload_page(&reading_cur);
+                unload_page(&reading_next);
                 partial_redraw = 1;
                 return 1;
             }
         }
-        if (reading_page_data == NULL)
+        else if (key == sk_Down && reading_cur.data != NULL)
         {
-            reading_page_size = quickrdr_get_page_size(reading_book, reading_page);
-            if (!reading_page_size)
+            if (reading_line + 1 < reading_cur.line_count)
             {
-                show_alert("Failed to get page size");
-                state = state_main;
-                return 1;
+                // the line scrolled in at the bottom may come from the next page
+                load_next_page();
+                if (state != state_reading)
+                {
+                    return 1;
+                }
+                reading_line++;
+                reading_scroll = 1;
             }
-            dbg_printf("Page size: %u\n", reading_page_size);
-            reading_page_data = malloc(reading_page_size);
-            if (reading_page_data == NULL)
+            else if (load_next_page())
             {
-                show_alert("Failed to allocate memory");
-                state = state_main;
-                return 1;
+                unload_page(&reading_cur);
+                reading_cur = reading_next;
+                reading_next.data = NULL;
+                reading_page++;
+                reading_line = 0;
+                reading_scroll = 1;
+                save_position(false);
             }
-            uint24_t read = quickrdr_read_page(reading_book, reading_page, reading_page_data);
-            if (!read)
+            partial_redraw = 1;
+            return 1;
+        }
+        else if (key == sk_Up && reading_cur.data != NULL)
+        {
+            if (reading_line > 0)
             {
-                show_alert("Failed to read page");
-                state = state_main;
-                return 1;
+                reading_line--;
+                reading_scroll = -1;
             }
-            dbg_printf("Page data[0]: %u\n", reading_page_data[0]);
-            uint8_t var = ti_Open("QKRDSAVE", "w");
-            if (var != 0)
+            else if (reading_page > 0)
             {
-                quickrdr_save_t save;
-                quickrdr_get_book_filename(reading_book, save.filename);
-                save.page = reading_page;
-                ti_Write(&save, sizeof(save), 1, var);
-                ti_SetArchiveStatus(1, var);
-                ti_Close(var);
+                reading_page_t prev;
+                if (!load_page(reading_page - 1, &prev))
+                {
+                    return 1;
+                }
+                unload_page(&reading_next);
+                reading_next = reading_cur;
+                reading_cur = prev;
+                reading_page--;
+                reading_line = reading_cur.line_count - 1;
+                reading_scroll = -1;
+                save_position(false);
             }
+            partial_redraw = 1;
+            return 1;
+        }
+        if (reading_cur.data == NULL && page_flipping())
+        {
+            // still flipping, only the page counter is updated until the key is released
+            partial_redraw = 1;
+            return 1;
+        }
+        if (reading_cur.data == NULL)
+        {
+            if (!load_page(reading_page, &reading_cur))
+            {
+                return 1;
+            }
+            dbg_printf("Page data[0]: %u\n", reading_cur.data[0]);
+            save_position(false);
         }
         else
         {
@@ -440,12 +886,143 @@ static int step(void)
             state = state_main;
         }
     }
-    else if (state == state_settings || state == state_about)
+    else if (state == state_settings)
     {
         if (key == sk_Clear)
         {
+            save_settings();
             state = state_main;
         }
+        else if (key == sk_Up)
+        {
+            if (settings_option == 0)
+            {
+                settings_option = setting_count;
+            }
+            settings_option--;
+        }
+        else if (key == sk_Down)
+        {
+            if (++settings_option >= setting_count)
+            {
+                settings_option = 0;
+            }
+        }
+        else if (key == sk_Left)
+        {
+            if (settings_choice[settings_option] > 0)
+            {
+                settings_choice[settings_option]--;
+            }
+        }
+        else if (key == sk_Right)
+        {
+            if (settings_choice[settings_option] < setting_choices - 1)
+            {
+                settings_choice[settings_option]++;
+            }
+        }
+    }
+    else if (state == state_about)
+    {
+        if (key == sk_Clear)
+        {
+            state = state_main;
+        }
+    }
+    return 1;
+}
+
+// finds the page and line shown as line `index` of the text area
+static reading_page_t *view_line(uint8_t index, uint8_t *line)
+{
+    unsigned int n = reading_line + index;
+    if (n < reading_cur.line_count)
+    {
+        *line = n;
+        return &reading_cur;
+    }
+    n -= reading_cur.line_count;
+    if (reading_next.data != NULL && n < reading_next.line_count)
+    {
+        *line = n;
+        return &reading_next;
+    }
+    return NULL;
+}
+
+// returns 0 (after an alert) on failure
+static uint8_t draw_line(reading_page_t *page, uint8_t line, uint8_t y)
+{
+    const uint8_t *data = page->data + page->line_start[line];
+    const uint8_t *end = page->data + page->size;
+#ifndef QUICKRDR_C_DRAW
+    if (reading_font_ready)
+    {
+        if (!textmode_draw_line(reading_area.x, y, data, end, &reading_font))
+        {
+            show_alert("Failed to read glyph");
+            return 0;
+        }
+        return 1;
+    }
+#endif
+    // reference implementation of textmode_draw_line(), and the only one for version 1 books
+    unsigned int x = reading_area.x;
+    while (data < end)
+    {
+        uint16_t glyph_id;
+        data += quickrdr_next_char(reading_book, data, &glyph_id);
+        if (glyph_id == 0)
+        {
+            break;
+        }
+        const quickrdr_glyph_t *glyph = quickrdr_get_glyph(reading_book, glyph_id);
+        if (glyph == NULL)
+        {
+            show_alert("Failed to read glyph");
+            return 0;
+        }
+        dbg_printf("Glyph %u @ (%u, %u)\n", glyph_id, x, y);
+        textmode_draw_glyph(x, y, glyph);
+        x += glyph->width;
+    }
+    return 1;
+}
+
+// renders the whole text area, or after scrolling only the line that came into view
+static uint8_t draw_text(int8_t scroll)
+{
+    uint8_t line_height = reading_area.line_height;
+    uint8_t lines = reading_area.lines;
+    uint8_t first = 0;
+    uint8_t last = lines;
+    if (scroll > 0)
+    {
+        textmode_shift_up(reading_area.y, lines * line_height, line_height);
+        first = lines - 1;
+    }
+    else if (scroll < 0)
+    {
+        textmode_shift_down(reading_area.y, lines * line_height, line_height);
+        last = 1;
+    }
+    else
+    {
+        textmode_fill_rows(TEXTMODE_TEXT_Y, TEXTMODE_TEXT_HEIGHT, 0);
+    }
+    for (uint8_t i = first; i < last; i++)
+    {
+        uint8_t line;
+        reading_page_t *page = view_line(i, &line);
+        if (page == NULL)
+        {
+            break;
+        }
+        if (!draw_line(page, line, reading_area.y + i * line_height))
+        {
+            return 0;
+        }
     }
     return 1;
 }
@@ -453,14 +1030,44 @@ static int step(void)
 static void draw(void)
 {
     static char buf[32];
+    // books are read in 1bpp, everything else uses the 8bpp graphx buffers
+    if (state == state_reading)
+    {
+        // the book is opened after the first frame, anti-aliased books switch to 2bpp then
+        // unless try_continue_book() already showed a snapshot in 2bpp
+        uint8_t depth = reading_book != NULL ? quickrdr_glyph_bpp(reading_book) : textmode_active() ? textmode_bpp() : 1;
+        if (textmode_active() && textmode_bpp() != depth)
+        {
+            textmode_end(COLOR_MAIN_BG);
+            partial_redraw = 0;
+        }
+        if (!textmode_active())
+        {
+            textmode_begin(depth, text_colors);
+            reading_drawn_page = -1;
+        }
+    }
+    else if (textmode_active())
+    {
+        textmode_end(COLOR_MAIN_BG);
+    }
     if (!partial_redraw)
     {
         // top & bottom bar
         gfx_SetColor(COLOR_BAR_BG);
-        gfx_FillRectangle_NoClip(0, 0, 320, 240);
-        // main menu
-        gfx_SetColor(COLOR_MAIN_BG);
-        gfx_FillRectangle_NoClip(0, 24, 320, 196);
+        if (textmode_active())
+        {
+            // only the bars are converted from gfx_vbuffer
+            gfx_FillRectangle_NoClip(0, 0, 320, 24);
+            gfx_FillRectangle_NoClip(0, 220, 320, 20);
+        }
+        else
+        {
+            gfx_FillRectangle_NoClip(0, 0, 320, 240);
+            // main menu
+            gfx_SetColor(COLOR_MAIN_BG);
+            gfx_FillRectangle_NoClip(0, 24, 320, 196);
+        }
     }
     // top & bottom bar text
     gfx_SetTextFGColor(COLOR_BAR_TEXT);
@@ -539,85 +1146,113 @@ static void draw(void)
     }
     else if (state == state_reading)
     {
-        // top bar text
+        int8_t scroll = reading_scroll;
+        reading_scroll = 0;
+        bool changed = !partial_redraw || reading_page != reading_drawn_page || scroll;
+        if (!changed && !reading_count_stale)
+        {
+            // nothing changed since the last frame
+            return;
+        }
+        reading_drawn_page = reading_page;
+        reading_count_stale = false;
+        // bars are drawn into gfx_vbuffer and converted to 1bpp below
         if (reading_book)
         {
             gfx_PrintStringXY(reading_book->header.name, 8, 8);
+            unsigned int width = gfx_GetStringWidth(reading_book->header.name);
+            gfx_SetColor(COLOR_BAR_BG);
+            gfx_FillRectangle_NoClip(width + 8, 0, 312 - width, 24);
+            if (!reading_reflowed())
+            {
+                sprintf(buf, "Page %u/%u", reading_page + 1, reading_book->header.page_count);
+            }
+            else if (reading_page >= REFLOW_DETACHED_PAGE)
+            {
+                // resumed ahead of the index
+                sprintf(buf, "Page ?/%u+", reflow_index_count());
+            }
+            else
+            {
+                // "+" while the index is still growing
+                sprintf(buf, reflow_index_complete() ? "Page %u/%u" : "Page %u/%u+", reading_page + 1, reflow_index_count());
+            }
+            width = gfx_GetStringWidth(buf);
+            gfx_PrintStringXY(buf, 320 - width - 8, 8);
         }
-        if (reading_page_data != NULL && !partial_redraw)
+        if (!changed)
+        {
+            // only the page counter
+            textmode_pack_rows(&gfx_vbuffer[0][0], 0, 24, COLOR_BAR_BG);
+            return;
+        }
+        if (reading_cur.data != NULL)
         {
-            sprintf(buf, "Page %u/%u", reading_page + 1, reading_book->header.page_count);
-            unsigned int width = gfx_GetStringWidth(buf);
-            gfx_PrintStringXY(buf, 320 - width - 8, 8);
             // bottom bar text
-            gfx_PrintStringXY("[\x11\x10] Page [CLEAR] Back", 8, 226);
-            gfx_SetTextFGColor(COLOR_MAIN_TEXT);
-            gfx_SetTextBGColor(COLOR_MAIN_BG);
-            gfx_SetTextXY(8, 32);
-            uint8_t *data = reading_page_data;
-            quickrdr_glyph_t *glyph = malloc(reading_book->header.font_glyph_size);
-            if (glyph == NULL)
-            {
-                show_alert("Failed to allocate glyph");
-                state = state_main;
-                return;
-            }
-            unsigned int curX = 8, curY = 32;
-            while (data < reading_page_data + reading_page_size)
+            gfx_PrintStringXY("[\x11\x10] Page [\x1e\x1f] Scroll [CLEAR] Back", 8, 226);
+            if (scroll && partial_redraw)
             {
-                uint16_t glyph_id;
-                data += quickrdr_next_char(reading_book, data, &glyph_id);
-                if (glyph_id == 0)
+                if (!draw_text(scroll))
                 {
-                    curX = 8;
-                    curY += reading_book->header.line_height;
-                    continue;
+                    state = state_main;
+                    return;
                 }
-                if (!quickrdr_read_glyph(reading_book, glyph_id, glyph))
+            }
+            else if (reading_line != 0 || !textmode_cache_load(reading_page))
+            {
+                if (!draw_text(0))
                 {
-                    show_alert("Failed to read glyph");
                     state = state_main;
-                    free(glyph);
                     return;
                 }
-                dbg_printf("Glyph %u @ (%u, %u)\n", glyph_id, curX, curY);
-                gfx_SetColor(COLOR_MAIN_TEXT);
-                for (int i = 0; i < glyph->height; i++)
+                // the cache only keeps pages as shown by page turns
+                if (reading_line == 0)
                 {
-                    for (int j = 0; j < glyph->width; j++)
-                    {
-                        if (getbit(glyph->data, i * glyph->width + j))
-                        {
-                            gfx_SetPixel(curX + j, curY + i);
-                        }
-                    }
+                    textmode_cache_store(reading_page);
                 }
-                curX += glyph->width;
+                dbg_printf("Done printing page %u\n", reading_page);
             }
-            free(glyph);
-            dbg_printf("Done printing page %u\n", reading_page);
+            textmode_pack_rows(&gfx_vbuffer[0][0], 220, 20, COLOR_BAR_BG);
         }
-        if (reading_page_data == NULL)
+        else
         {
-            unsigned int width = reading_book != NULL ? gfx_GetStringWidth(reading_book->header.name) : 0;
-            gfx_SetColor(COLOR_BAR_BG);
-            gfx_FillRectangle_NoClip(width + 8, 0, 312 - width, 24);
-            strcpy(buf, "Loading...");
-            width = gfx_GetStringWidth(buf);
-            gfx_PrintStringXY(buf, 320 - width - 8, 8);
+            // skimming or loading: show the page if it is cached, otherwise keep the old text
+            textmode_cache_load(reading_page);
         }
+        textmode_pack_rows(&gfx_vbuffer[0][0], 0, 24, COLOR_BAR_BG);
     }
     else if (state == state_settings)
     {
         // top bar text
         gfx_PrintStringXY("QUICKRDR: Settings", 8, 8);
         // bottom bar text
-        gfx_PrintStringXY("[CLEAR] Back", 8, 226);
-        // main text
+        gfx_PrintStringXY("[\x1e\x1f] Item [\x11\x10] Change [CLEAR] Back", 8, 226);
+        static const char *setting_names[] = {
+            [setting_margin] = "Margins",
+            [setting_line_spacing] = "Line spacing",
+        };
+        const uint8_t *setting_values[] = {
+            [setting_margin] = setting_margins,
+            [setting_line_spacing] = setting_line_spacings,
+        };
+        for (quickrdr_setting_t i = 0; i < setting_count; i++)
+        {
+            gfx_SetColor(settings_option == i ? COLOR_HIGHLIGHT_BG : COLOR_MAIN_BG);
+            gfx_FillRectangle_NoClip(0, 30 + i * 32, 320, 20);
+            gfx_SetTextFGColor(settings_option == i ? COLOR_HIGHLIGHT_TEXT : COLOR_MAIN_TEXT);
+            gfx_SetTextBGColor(settings_option == i ? COLOR_HIGHLIGHT_BG : COLOR_MAIN_BG);
+            gfx_PrintStringXY(setting_names[i], 24, 36 + i * 32);
+            sprintf(buf, "%c %u px %c", settings_choice[i] > 0 ? '\x11' : ' ', setting_values[i][settings_choice[i]], settings_choice[i] < setting_choices - 1 ? '\x10' : ' ');
+            gfx_PrintStringXY(buf, 200, 36 + i * 32);
+            if (settings_option == i)
+            {
+                gfx_PrintStringXY(">", 8, 36 + i * 32);
+            }
+        }
         gfx_SetTextFGColor(COLOR_MAIN_TEXT);
         gfx_SetTextBGColor(COLOR_MAIN_BG);
-        // gfx_PrintStringXY("Settings", 8, 36);
-        gfx_PrintStringXY("No settings needed. Just read!", 8, 36);
+        gfx_PrintStringXY("Older books keep the layout they were", 8, 180);
+        gfx_PrintStringXY("converted with.", 8, 196);
     }
     else if (state == state_about)
     {
@@ -658,6 +1293,11 @@ int main()
     gfx_SetPalette(quickrdr_palette, sizeof(quickrdr_palette), 0);
     gfx_ZeroScreen();
 
+    timer_Enable(REPEAT_TIMER, TIMER_32K, TIMER_NOINT, TIMER_UP);
+    scratch_begin();
+    bench_begin();
+
+    load_settings();
     // load the total count
     book_list_total_count = quickrdr_count_files();
 
@@ -666,12 +1306,32 @@ int main()
         // dbg_printf("State: %u, partial redraw: %u\n", state, partial_redraw);
         if (partial_redraw)
         {
-            gfx_BlitScreen();
+            if (textmode_active())
+            {
+                textmode_blit();
+            }
+            else
+            {
+                gfx_BlitScreen();
+            }
         }
         draw();
-        gfx_SwapDraw();
+        if (textmode_active())
+        {
+            textmode_swap();
+        }
+        else
+        {
+            gfx_SwapDraw();
+        }
+        // a page turn has settled once its page is loaded and drawn
+        bench_frame(state != state_reading || reading_cur.data != NULL, state, reading_page);
     }
 
+    bench_end();
+    textmode_end(COLOR_MAIN_BG);
+    scratch_end();
+    timer_Disable(REPEAT_TIMER);
     gfx_End();
     return 0;
 }
\ No newline at end of file
@@ -5,7 +5,7 @@
 
 #include <string.h>
 
-#define CHUNK_SIZE 65460
+#define CHUNK_SIZE QUICKRDR_CHUNK_SIZE
 
 static char *find_next_appvar(void **search_pos)
 {
@@ -77,6 +77,7 @@ static int book_seek(quickrdr_book_handle_t book, uint24_t offset)
     return 0;
 }
 
+// version 1 only, records may be split between chunks
 static size_t book_read(quickrdr_book_handle_t book, void *buf, size_t size)
 {
     size_t read = 0;
@@ -87,7 +88,7 @@ static size_t book_read(quickrdr_book_handle_t book, void *buf, size_t size)
         {
             chunk_size = size;
         }
-        memcpy(buf, book->chunk_pointer[book->cur_offset / CHUNK_SIZE] + book->cur_offset, chunk_size);
+        memcpy(buf, book->chunk_pointer[book->cur_offset / CHUNK_SIZE] + book->cur_offset % CHUNK_SIZE, chunk_size);
         buf += chunk_size;
         size -= chunk_size;
         book->cur_offset += chunk_size;
@@ -96,6 +97,111 @@ static size_t book_read(quickrdr_book_handle_t book, void *buf, size_t size)
     return read;
 }
 
+// version 2 and later only
+static const uint8_t *book_pointer(quickrdr_book_handle_t book, uint24_t address)
+{
+    uint8_t chunk = address >> 16;
+    if (chunk >= book->chunk_count)
+    {
+        return NULL;
+    }
+    return book->chunk_pointer[chunk] + (address & 0xFFFF);
+}
+
+static void table_init(quickrdr_table_t *table, uint24_t address, uint16_t record_size)
+{
+    table->address = address;
+    table->first_count = (CHUNK_SIZE - (address & 0xFFFF)) / record_size;
+    table->per_chunk = CHUNK_SIZE / record_size;
+}
+
+static const uint8_t *table_record(quickrdr_book_handle_t book, const quickrdr_table_t *table, uint16_t record_size, uint24_t index)
+{
+    if (index < table->first_count)
+    {
+        return book_pointer(book, table->address + index * record_size);
+    }
+    index -= table->first_count;
+    uint8_t chunk = (table->address >> 16) + 1 + index / table->per_chunk;
+    return book_pointer(book, QUICKRDR_ADDRESS((uint24_t)chunk, (index % table->per_chunk) * record_size));
+}
+
+static void chunk_name(char *buf, const char *filename, unsigned int chunk)
+{
+    strcpy(buf, filename);
+    size_t len = strlen(buf);
+    buf[len - 2] = '0' + chunk / 10;
+    buf[len - 1] = '0' + chunk % 10;
+}
+
+// version 4 and later, see chunkName() in website/src/convert/ti.ts
+static void chunk_hash_name(char *buf, const char *filename, uint32_t hash)
+{
+    memcpy(buf, filename, 3);
+    for (uint8_t i = 3; i < 8; i++)
+    {
+        buf[i] = 'A' + hash % 26;
+        hash /= 26;
+    }
+    buf[8] = '\0';
+}
+
+// builds the decoder of a version 6 book from the code after chunk_hash[]
+static uint8_t build_decoder(quickrdr_book_handle_t book)
+{
+    const uint8_t *code = book->chunk_pointer[0] + sizeof(quickrdr_header_t) + sizeof(quickrdr_layout_t) +
+                          book->chunk_count * (sizeof(uint16_t) + sizeof(uint32_t));
+    memcpy(&book->code, code, sizeof(book->code));
+    if (book->code.glyph_bpp != 1 && book->code.glyph_bpp != 2)
+    {
+        dbg_printf("Invalid glyph depth %u\n", book->code.glyph_bpp);
+        return 0;
+    }
+    quickrdr_decoder_t *decoder = calloc(1, sizeof(quickrdr_decoder_t));
+    if (decoder == NULL)
+    {
+        dbg_printf("Failed to allocate the decoder\n");
+        return 0;
+    }
+    book->decoder = decoder;
+    table_init(&decoder->symbol_table, book->code.symbol_table, sizeof(uint16_t));
+    // canonical codes: each length continues from the last code of the one before
+    uint32_t code_value = 0;
+    uint24_t symbol = 0;
+    for (uint8_t length = 1; length <= QUICKRDR_MAX_CODE_LENGTH; length++)
+    {
+        uint16_t count = book->code.length_count[length - 1];
+        decoder->first_code[length] = code_value;
+        decoder->first_symbol[length] = symbol;
+        decoder->count[length] = count;
+        if (code_value + count > (uint32_t)1 << length)
+        {
+            dbg_printf("Invalid code lengths\n");
+            return 0;
+        }
+        for (uint16_t i = 0; i < count && length <= QUICKRDR_LOOKUP_BITS; i++)
+        {
+            const uint8_t *entry = table_record(book, &decoder->symbol_table, sizeof(uint16_t), symbol + i);
+            if (entry == NULL)
+            {
+                dbg_printf("Symbol table runs past the book\n");
+                return 0;
+            }
+            // every lookup index that starts with this code
+            uint8_t shift = QUICKRDR_LOOKUP_BITS - length;
+            unsigned int first = (code_value + i) << shift;
+            for (unsigned int j = first; j < first + (1U << shift); j++)
+            {
+                decoder->length[j] = length;
+                decoder->glyph_id[j] = entry[0] | (entry[1] << 8);
+            }
+        }
+        code_value = (code_value + count) << 1;
+        symbol += count;
+    }
+    return 1;
+}
+
 quickrdr_book_handle_t quickrdr_open_book(const char *filename)
 {
     size_t len = strlen(filename);
@@ -116,40 +222,96 @@ quickrdr_book_handle_t quickrdr_open_book(const char *filename)
         dbg_printf("Failed to open book var %s\n", filename);
         goto err_free;
     }
-    size_t read = ti_Read(&book->header, sizeof(book->header), 1, var0);
-    if (read != 1)
+    if (ti_Read(&book->header, sizeof(book->header), 1, var0) != 1)
     {
-        dbg_printf("Read failed, read %u bytes\n", read);
+        dbg_printf("Failed to read the header of %s\n", filename);
         goto err_close;
     }
-    ti_Close(var0);
     if (memcmp(book->header.magic, "QRDR", 4) != 0)
     {
         dbg_printf("Invalid magic data\n");
-        goto err_free;
+        goto err_close;
     }
-    if (book->header.version != 1)
+    if (book->header.version == 1)
+    {
+        if (book->header.total_size > 100 * CHUNK_SIZE)
+        {
+            dbg_printf("Book too large: %u\n", book->header.total_size);
+            goto err_close;
+        }
+        book->chunk_count = (book->header.total_size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        book->glyph_buffer = malloc(book->header.font_glyph_size);
+        if (book->glyph_buffer == NULL)
+        {
+            dbg_printf("Failed to allocate glyph buffer\n");
+            goto err_close;
+        }
+    }
+    else if (book->header.version >= 2 && book->header.version <= 6)
+    {
+        if (book->header.version >= 4 && len < 5)
+        {
+            dbg_printf("Filename %s has no base name\n", filename);
+            goto err_close;
+        }
+        if (book->header.version == 6 && book->header.page_count > QUICKRDR_MAX_CODED_BLOCKS)
+        {
+            dbg_printf("Too many blocks: %u\n", book->header.page_count);
+            goto err_close;
+        }
+        quickrdr_layout_t layout;
+        if (ti_Read(&layout, sizeof(layout), 1, var0) != 1 || layout.chunk_count > 100 ||
+            ti_Read(book->chunk_size, sizeof(uint16_t), layout.chunk_count, var0) != layout.chunk_count)
+        {
+            dbg_printf("Invalid layout\n");
+            goto err_close;
+        }
+        book->chunk_count = layout.chunk_count;
+        table_init(&book->page_table, layout.page_table, sizeof(uint24_t));
+        table_init(&book->glyph_table, layout.glyph_table, book->header.font_glyph_size);
+    }
+    else
     {
         dbg_printf("Invalid version %u\n", book->header.version);
-        goto err_free;
+        goto err_close;
     }
-    for (unsigned int i = 0; i < (book->header.total_size + CHUNK_SIZE - 1) / CHUNK_SIZE; i++)
+    ti_Close(var0);
+    for (unsigned int i = 0; i < book->chunk_count; i++)
     {
         dbg_printf("Loading chunk %u\n", i);
         char buf[10] = {0};
-        strcpy(buf, filename);
-        size_t len = strlen(buf);
-        buf[len - 2] = '0' + i / 10;
-        buf[len - 1] = '0' + i % 10;
+        if (book->header.version >= 4 && i > 0)
+        {
+            // chunk 0 is loaded first and lists the hashes
+            uint32_t hash;
+            memcpy(&hash, book->chunk_pointer[0] + sizeof(quickrdr_header_t) + sizeof(quickrdr_layout_t) +
+                              book->chunk_count * sizeof(uint16_t) + i * sizeof(uint32_t),
+                   sizeof(hash));
+            chunk_hash_name(buf, filename, hash);
+        }
+        else
+        {
+            chunk_name(buf, filename, i);
+        }
         uint8_t var = ti_Open(buf, "r");
         if (var == 0)
         {
             dbg_printf("Failed to open book var %s\n", buf);
-            goto err_close;
+            goto err_free;
+        }
+        if (book->header.version != 1 && ti_GetSize(var) != book->chunk_size[i])
+        {
+            dbg_printf("Book var %s has size %u, expected %u\n", buf, ti_GetSize(var), book->chunk_size[i]);
+            ti_Close(var);
+            goto err_free;
         }
         book->chunk_pointer[i] = ti_GetDataPtr(var);
         ti_Close(var);
     }
+    if (book->header.version == 6 && !build_decoder(book))
+    {
+        goto err_free;
+    }
     strncpy(book->filename, filename, sizeof(book->filename));
     book->cur_offset = 0;
 
@@ -158,43 +320,150 @@ quickrdr_book_handle_t quickrdr_open_book(const char *filename)
 err_close:
     ti_Close(var0);
 err_free:
+    free(book->glyph_buffer);
+    free(book->decoder);
     free(book);
     return NULL;
 }
 
+uint32_t quickrdr_book_identity(const char *filename)
+{
+    uint8_t var = ti_Open(filename, "r");
+    if (var == 0)
+    {
+        return 0;
+    }
+    const uint8_t *data = ti_GetDataPtr(var);
+    size_t size = ti_GetSize(var);
+    ti_Close(var);
+    const quickrdr_header_t *header = (const quickrdr_header_t *)data;
+    size_t length = sizeof(quickrdr_header_t);
+    if (size >= length + sizeof(quickrdr_layout_t) && header->version >= 2)
+    {
+        uint8_t chunk_count = ((const quickrdr_layout_t *)(data + length))->chunk_count;
+        length += sizeof(quickrdr_layout_t) + chunk_count * (header->version >= 4 ? sizeof(uint16_t) + sizeof(uint32_t) : sizeof(uint16_t));
+    }
+    if (size < length)
+    {
+        return 0;
+    }
+    // FNV-1a, like the chunk hashes
+    uint32_t hash = 2166136261UL;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619UL;
+    }
+    return hash;
+}
+
 void quickrdr_close_book(quickrdr_book_handle_t book)
 {
     if (book == NULL)
     {
         return;
     }
+    free(book->glyph_buffer);
+    free(book->decoder);
     free(book);
 }
 
 #define dbg(var) dbg_printf("%s = %u\n", #var, var)
 
-static uint24_t book_calculate_glyph_offset(quickrdr_book_handle_t book, uint16_t glyph_id)
+uint24_t quickrdr_glyph_index(quickrdr_book_handle_t book, uint16_t glyph_id)
 {
     if (glyph_id < 256U)
     {
-        return sizeof(book->header) + book->header.page_count * sizeof(uint24_t) +
-               (glyph_id - 1) * book->header.font_glyph_size;
+        return glyph_id - 1;
     }
-    else
+    // two byte glyphs
+    uint8_t extension_byte = glyph_id >> 8;
+    return (book->header.min_extension_byte - 1) +
+           (extension_byte - book->header.min_extension_byte) * 256U +
+           (glyph_id & 0xFF);
+}
+
+uint8_t quickrdr_get_font(quickrdr_book_handle_t book, quickrdr_font_t *font)
+{
+    if (book->header.version == 1)
+    {
+        return 0;
+    }
+    const quickrdr_table_t *table = &book->glyph_table;
+    font->min_extension_byte = book->header.min_extension_byte;
+    font->glyph_size = book->header.font_glyph_size;
+    font->glyph_count = book->header.font_glyph_count;
+    // a run for the chunk of the first glyph and one for each chunk after it
+    uint8_t chunk = table->address >> 16;
+    uint24_t offset = table->address & 0xFFFF;
+    uint24_t first = 0;
+    uint8_t run = 0;
+    while (first < font->glyph_count)
+    {
+        const uint8_t *records = book_pointer(book, QUICKRDR_ADDRESS((uint24_t)chunk, offset));
+        if (records == NULL)
+        {
+            dbg_printf("Glyph table runs past chunk %u\n", chunk);
+            return 0;
+        }
+        font->runs[run].first = first;
+        font->runs[run].records = records;
+        first += run == 0 ? table->first_count : table->per_chunk;
+        run++;
+        chunk++;
+        offset = 0;
+    }
+    font->runs[run].first = 0xFFFFFF;
+    return 1;
+}
+
+uint8_t quickrdr_glyph_bpp(quickrdr_book_handle_t book)
+{
+    if (book->header.version == 6)
+    {
+        return book->code.glyph_bpp;
+    }
+    return book->header.version == 5 ? 2 : 1;
+}
+
+static uint24_t book_calculate_glyph_offset(quickrdr_book_handle_t book, uint16_t glyph_id)
+{
+    return sizeof(book->header) + book->header.page_count * sizeof(uint24_t) +
+           quickrdr_glyph_index(book, glyph_id) * book->header.font_glyph_size;
+}
+
+const quickrdr_glyph_t *quickrdr_get_glyph(quickrdr_book_handle_t book, uint16_t glyph_id)
+{
+    if (book->header.version == 1)
+    {
+        return quickrdr_read_glyph(book, glyph_id, book->glyph_buffer) ? book->glyph_buffer : NULL;
+    }
+    uint24_t index = quickrdr_glyph_index(book, glyph_id);
+    if (glyph_id == 0 || index >= book->header.font_glyph_count)
+    {
+        dbg_printf("Glyph %u out of bounds\n", glyph_id);
+        return NULL;
+    }
+    const quickrdr_glyph_t *glyph = (const quickrdr_glyph_t *)table_record(book, &book->glyph_table, book->header.font_glyph_size, index);
+    if (glyph == NULL || glyph->glyph_id != glyph_id)
     {
-        // two byte glyphs
-        uint8_t extension_byte = glyph_id >> 8;
-        dbg(book->header.min_extension_byte);
-        dbg(extension_byte);
-        return sizeof(book->header) + book->header.page_count * sizeof(uint24_t) +
-               (book->header.min_extension_byte - 1) * book->header.font_glyph_size +
-               (extension_byte - book->header.min_extension_byte) * 256U * book->header.font_glyph_size +
-               (glyph_id & 0xFF) * book->header.font_glyph_size;
+        dbg_printf("Glyph ID mismatch, expected %u\n", glyph_id);
+        return NULL;
     }
+    return glyph;
 }
 
 uint8_t quickrdr_read_glyph(quickrdr_book_handle_t book, uint16_t glyph_id, quickrdr_glyph_t *glyph)
 {
+    if (book->header.version != 1)
+    {
+        const quickrdr_glyph_t *src = quickrdr_get_glyph(book, glyph_id);
+        if (src == NULL)
+        {
+            return 0;
+        }
+        memcpy(glyph, src, book->header.font_glyph_size);
+        return 1;
+    }
     uint24_t offset = book_calculate_glyph_offset(book, glyph_id);
     dbg_printf("Reading glyph %u, offset %u\n", glyph_id, offset);
     if (book_seek(book, offset) == EOF)
@@ -224,6 +493,15 @@ static uint24_t quickrdr_get_page_offset(quickrdr_book_handle_t book, uint24_t p
         dbg_printf("Page %u out of bounds\n", page);
         return 0;
     }
+    if (book->header.version != 1)
+    {
+        const uint8_t *entry = table_record(book, &book->page_table, sizeof(uint24_t), page);
+        if (entry == NULL)
+        {
+            return 0;
+        }
+        return *(const uint24_t *)entry;
+    }
     uint24_t offset = sizeof(quickrdr_header_t) + page * sizeof(uint24_t);
     if (book_seek(book, offset) == EOF)
     {
@@ -247,6 +525,20 @@ uint24_t quickrdr_get_page_size(quickrdr_book_handle_t book, uint24_t page)
     {
         return 0;
     }
+    if (book->header.version != 1)
+    {
+        // pages are packed, except for the unstored padding at the end of a chunk
+        uint8_t chunk = page_offset >> 16;
+        if (page + 1 < book->header.page_count)
+        {
+            uint24_t next_page_offset = quickrdr_get_page_offset(book, page + 1);
+            if (next_page_offset >> 16 == chunk)
+            {
+                return next_page_offset - page_offset;
+            }
+        }
+        return book->chunk_size[chunk] - (page_offset & 0xFFFF);
+    }
     if (page == book->header.page_count - 1)
     {
         dbg_printf("Last page %u, offset %u, total size %u\n", page, page_offset, book->header.total_size);
@@ -260,6 +552,25 @@ uint24_t quickrdr_get_page_size(quickrdr_book_handle_t book, uint24_t page)
     return next_page_offset - page_offset;
 }
 
+const uint8_t *quickrdr_get_page(quickrdr_book_handle_t book, uint24_t page, uint24_t *size)
+{
+    uint24_t page_offset = quickrdr_get_page_offset(book, page);
+    *size = quickrdr_get_page_size(book, page);
+    if (*size == 0)
+    {
+        return NULL;
+    }
+    if (book->header.version != 1)
+    {
+        return book_pointer(book, page_offset);
+    }
+    if (page_offset % CHUNK_SIZE + *size > CHUNK_SIZE)
+    {
+        return NULL;
+    }
+    return book->chunk_pointer[page_offset / CHUNK_SIZE] + page_offset % CHUNK_SIZE;
+}
+
 uint24_t quickrdr_read_page(quickrdr_book_handle_t book, uint24_t page, uint8_t *data)
 {
     uint24_t page_offset = quickrdr_get_page_offset(book, page);
@@ -273,6 +584,11 @@ uint24_t quickrdr_read_page(quickrdr_book_handle_t book, uint24_t page, uint8_t
         return 0;
     }
     dbg_printf("Reading page %u, offset %u, size %u\n", page, page_offset, size);
+    if (book->header.version != 1)
+    {
+        memcpy(data, book_pointer(book, page_offset), size);
+        return size;
+    }
     if (book_seek(book, page_offset) == EOF)
     {
         return 0;
@@ -285,7 +601,7 @@ uint24_t quickrdr_read_page(quickrdr_book_handle_t book, uint24_t page, uint8_t
     return size;
 }
 
-uint8_t quickrdr_next_char(quickrdr_book_handle_t book, uint8_t *data, uint16_t *glyph_id)
+uint8_t quickrdr_next_char(quickrdr_book_handle_t book, const uint8_t *data, uint16_t *glyph_id)
 {
     uint8_t byte = *data++;
     if (book->header.min_extension_byte && byte >= book->header.min_extension_byte)
@@ -300,6 +616,32 @@ uint8_t quickrdr_next_char(quickrdr_book_handle_t book, uint8_t *data, uint16_t
     }
 }
 
+uint8_t quickrdr_index_lines(quickrdr_book_handle_t book, const uint8_t *data, uint24_t size, uint24_t *line_start, uint8_t max_lines)
+{
+    if (max_lines == 0)
+    {
+        return 0;
+    }
+    uint8_t count = 0;
+    uint24_t offset = 0;
+    line_start[count++] = 0;
+    while (offset < size)
+    {
+        uint16_t glyph_id;
+        // two byte glyph IDs may contain a zero byte, so decode instead of searching
+        offset += quickrdr_next_char(book, data + offset, &glyph_id);
+        if (glyph_id == 0)
+        {
+            if (count == max_lines)
+            {
+                break;
+            }
+            line_start[count++] = offset;
+        }
+    }
+    return count;
+}
+
 void quickrdr_get_book_filename(quickrdr_book_handle_t book, char *filename)
 {
     if (book == NULL)
@@ -309,3 +651,216 @@ void quickrdr_get_book_filename(quickrdr_book_handle_t book, char *filename)
     }
     strcpy(filename, book->filename);
 }
+
+// glyph streams (version 3 and later)
+
+static void cursor_end(quickrdr_book_handle_t book, quickrdr_cursor_t *cursor)
+{
+    cursor->block = book->header.page_count;
+    cursor->address = QUICKRDR_STREAM_END;
+    cursor->start = cursor->data = cursor->end = NULL;
+}
+
+static uint8_t cursor_load(quickrdr_book_handle_t book, quickrdr_cursor_t *cursor, uint24_t block)
+{
+    uint24_t size;
+    const uint8_t *start = quickrdr_get_page(book, block, &size);
+    if (start == NULL)
+    {
+        return 0;
+    }
+    cursor->block = block;
+    cursor->address = quickrdr_get_page_offset(book, block);
+    cursor->start = start;
+    cursor->data = start;
+    cursor->end = start + size;
+    cursor->count = 0;
+    if (book->decoder != NULL)
+    {
+        if (size < sizeof(uint16_t))
+        {
+            return 0;
+        }
+        cursor->count = start[0] | (start[1] << 8);
+        cursor->data += sizeof(uint16_t);
+        cursor->bit = 0;
+        cursor->ordinal = 0;
+    }
+    return 1;
+}
+
+static uint8_t cursor_block_end(quickrdr_book_handle_t book, const quickrdr_cursor_t *cursor)
+{
+    return book->decoder != NULL ? cursor->ordinal == cursor->count : cursor->data == cursor->end;
+}
+
+// reads the next code of a version 6 block
+static uint8_t cursor_decode(quickrdr_book_handle_t book, quickrdr_cursor_t *cursor, uint16_t *glyph_id)
+{
+    const quickrdr_decoder_t *decoder = book->decoder;
+    const uint8_t *data = cursor->data;
+    // the next 16 bits, zeros past the end of the block
+    uint24_t window = (uint24_t)data[0] << 16;
+    if (data + 1 < cursor->end)
+    {
+        window |= (uint24_t)data[1] << 8;
+        if (data + 2 < cursor->end)
+        {
+            window |= data[2];
+        }
+    }
+    uint16_t bits = (window << cursor->bit) >> 8;
+    uint8_t length = decoder->length[bits >> 8];
+    if (length != 0)
+    {
+        *glyph_id = decoder->glyph_id[bits >> 8];
+    }
+    else
+    {
+        uint24_t symbol;
+        for (length = QUICKRDR_LOOKUP_BITS + 1;; length++)
+        {
+            if (length > QUICKRDR_MAX_CODE_LENGTH)
+            {
+                dbg_printf("Invalid code in block %u\n", cursor->block);
+                return 0;
+            }
+            uint16_t code = bits >> (QUICKRDR_MAX_CODE_LENGTH - length);
+            uint16_t first = decoder->first_code[length];
+            if (code >= first && code - first < decoder->count[length])
+            {
+                symbol = decoder->first_symbol[length] + (code - first);
+                break;
+            }
+        }
+        const uint8_t *entry = table_record(book, &decoder->symbol_table, sizeof(uint16_t), symbol);
+        if (entry == NULL)
+        {
+            return 0;
+        }
+        *glyph_id = entry[0] | (entry[1] << 8);
+    }
+    length += cursor->bit;
+    cursor->data += length >> 3;
+    cursor->bit = length & 7;
+    cursor->ordinal++;
+    return 1;
+}
+
+uint8_t quickrdr_cursor_begin(quickrdr_book_handle_t book, quickrdr_cursor_t *cursor)
+{
+    if (book->header.page_count == 0 || !cursor_load(book, cursor, 0))
+    {
+        cursor_end(book, cursor);
+        return 0;
+    }
+    return 1;
+}
+
+// keeps the cursor off block ends, so that every position has one address
+static void cursor_settle(quickrdr_book_handle_t book, quickrdr_cursor_t *cursor)
+{
+    while (cursor->address != QUICKRDR_STREAM_END && cursor_block_end(book, cursor))
+    {
+        if (cursor->block + 1 >= book->header.page_count || !cursor_load(book, cursor, cursor->block + 1))
+        {
+            cursor_end(book, cursor);
+        }
+    }
+}
+
+uint8_t quickrdr_cursor_seek(quickrdr_book_handle_t book, quickrdr_cursor_t *cursor, uint24_t address)
+{
+    if (address == QUICKRDR_STREAM_END)
+    {
+        cursor_end(book, cursor);
+        return 1;
+    }
+    if (book->decoder != NULL)
+    {
+        uint24_t block = address >> 10;
+        uint16_t ordinal = address & 0x3FF;
+        if (block >= book->header.page_count || !cursor_load(book, cursor, block) || ordinal >= cursor->count)
+        {
+            dbg_printf("Stream position %u not found\n", address);
+            return 0;
+        }
+        uint16_t glyph_id;
+        while (cursor->ordinal < ordinal)
+        {
+            if (!cursor_decode(book, cursor, &glyph_id))
+            {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    // last block that starts at or before the address
+    uint24_t low = 0;
+    uint24_t high = book->header.page_count;
+    while (high - low > 1)
+    {
+        uint24_t mid = low + (high - low) / 2;
+        if (quickrdr_get_page_offset(book, mid) <= address)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    if (!cursor_load(book, cursor, low) || address < cursor->address ||
+        address - cursor->address >= (uint24_t)(cursor->end - cursor->start))
+    {
+        dbg_printf("Stream position %u not found\n", address);
+        return 0;
+    }
+    cursor->data += address - cursor->address;
+    return 1;
+}
+
+uint8_t quickrdr_cursor_seek_block(quickrdr_book_handle_t book, quickrdr_cursor_t *cursor, uint24_t block)
+{
+    if (block >= book->header.page_count || !cursor_load(book, cursor, block))
+    {
+        return 0;
+    }
+    cursor_settle(book, cursor);
+    return 1;
+}
+
+uint8_t quickrdr_cursor_next(quickrdr_book_handle_t book, quickrdr_cursor_t *cursor, uint16_t *glyph_id)
+{
+    if (cursor->address == QUICKRDR_STREAM_END)
+    {
+        return 0;
+    }
+    if (book->decoder != NULL)
+    {
+        if (!cursor_decode(book, cursor, glyph_id))
+        {
+            cursor_end(book, cursor);
+            return 0;
+        }
+    }
+    else
+    {
+        cursor->data += quickrdr_next_char(book, cursor->data, glyph_id);
+    }
+    cursor_settle(book, cursor);
+    return 1;
+}
+
+uint24_t quickrdr_cursor_tell(quickrdr_book_handle_t book, const quickrdr_cursor_t *cursor)
+{
+    if (cursor->address == QUICKRDR_STREAM_END)
+    {
+        return QUICKRDR_STREAM_END;
+    }
+    if (book->decoder != NULL)
+    {
+        return QUICKRDR_CODED_POSITION(cursor->block, (uint24_t)cursor->ordinal);
+    }
+    return cursor->address + (cursor->data - cursor->start);
+}
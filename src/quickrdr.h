@@ -1,10 +1,24 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 #include <assert.h>
 
+#ifdef QUICKRDR_HOST
+// host tools (tools/qrconv) only need the layout, not 24-bit arithmetic
+typedef struct
+{
+    uint8_t bytes[3]; // little-endian
+} uint24_t;
+#endif
+
 #pragma pack(push, 1)
 
+// bytes of book data in each appvar
+#define QUICKRDR_CHUNK_SIZE 65460
+// version 2 addresses are (chunk << 16) | offset within the chunk
+#define QUICKRDR_ADDRESS(chunk, offset) (((chunk) << 16) | (offset))
+
 typedef struct
 {
     char magic[4];              // "QRDR"
@@ -16,13 +30,78 @@ typedef struct
     uint24_t font_glyph_count;  // number of glyphs in the font
     uint16_t font_glyph_size;    // size of each glyph in bytes (including header)
     uint24_t page_count;        // number of pages in the book
+    // version 1, a single stream split into appvars every QUICKRDR_CHUNK_SIZE bytes:
     // uint24_t page_offset[page_count];           // offset of each page in the file
     // quickrdr_glyph_t glyphs[font_glyph_count];  // glyphs in the font
     // uint8_t page_data[];                        // page data
+    // version 2:
+    // quickrdr_layout_t layout;
 } quickrdr_header_t;
 
 static_assert(sizeof(quickrdr_header_t) == 34, "quickrdr_header_t size mismatch");
 
+// Version 2 books never split a record (page table entry, glyph or page)
+// between appvars. Records of a table are packed into a chunk while they fit
+// and continue at the start of the next chunk; the rest of the chunk is
+// padding that is not stored. Every record is reachable through one pointer.
+typedef struct
+{
+    uint8_t chunk_count;  // number of appvars, at most 100
+    uint24_t page_table;  // address of uint24_t page_address[page_count]
+    uint24_t glyph_table; // address of quickrdr_glyph_t glyphs[font_glyph_count]
+    // uint16_t chunk_size[chunk_count];           // bytes stored in each appvar
+    // followed by the tables and the page data at the addresses above
+} quickrdr_layout_t;
+
+static_assert(sizeof(quickrdr_layout_t) == 7, "quickrdr_layout_t size mismatch");
+
+// Version 3 books have the version 2 layout, but instead of pages the page
+// table lists blocks of one continuous stream of glyph IDs, where 0 ends a
+// paragraph. The reader paginates the stream itself (see reflow.h), so
+// line_height is the font height without line spacing. Blocks are at most
+// QUICKRDR_BLOCK_SIZE bytes and never split a glyph ID.
+#define QUICKRDR_BLOCK_SIZE 1024
+// stream position past the last glyph
+#define QUICKRDR_STREAM_END 0xFFFFFF
+
+// Version 4 books are version 3 books laid out so that converting a revised
+// text changes as few appvars as possible. chunk_size[] is followed by
+// uint32_t chunk_hash[chunk_count], the FNV-1a hash of each chunk (0 for the
+// first). Chunk 0 is <base>00, chunk i the first 3 characters of <base>
+// followed by 5 letters from chunk_hash[i]. The glyph table and the stream
+// start chunks of their own, and the stream is split into chunks after
+// blocks cut by its content, so an edit only renames the chunks around it.
+
+// Version 5 books are version 4 books with anti-aliased glyphs: 2 bits per
+// pixel (0 background to 3 ink), first pixel in the top bits, and every row
+// padded to a whole byte so that rows can be shifted into place a byte at a
+// time (see textmode.h). Glyphs of other versions are 1 bit per pixel, with
+// rows not padded.
+
+// Version 6 books are version 4 or 5 books whose stream is coded with
+// canonical Huffman codes over glyph ID frequency. quickrdr_code_t follows
+// chunk_hash[]. Codes are assigned in the order of the symbol table: the
+// first length_count[0] symbols get the 1-bit codes 0, 1, ..., the next
+// length_count[1] ones the following 2-bit codes, and so on. Each block of
+// the stream is a uint16_t count of the glyph IDs in it followed by their
+// codes, first bit in the top bit of a byte, the last byte padded with 0.
+// Blocks hold at most QUICKRDR_BLOCK_SIZE glyph IDs, and since codes do not
+// start at byte boundaries a stream position is (block << 10) | the number
+// of glyph IDs before it in the block.
+#define QUICKRDR_MAX_CODE_LENGTH 16
+#define QUICKRDR_CODED_POSITION(block, ordinal) (((block) << 10) | (ordinal))
+// blocks of a version 6 book, their positions stay below QUICKRDR_STREAM_END
+#define QUICKRDR_MAX_CODED_BLOCKS 0x3FFF
+
+typedef struct
+{
+    uint8_t glyph_bpp;     // bits per pixel of the glyphs, as in version 4 or 5
+    uint24_t symbol_table; // address of uint16_t glyph_id[symbol_count] by code
+    uint16_t length_count[QUICKRDR_MAX_CODE_LENGTH]; // codes of 1 to 16 bits
+} quickrdr_code_t;
+
+static_assert(sizeof(quickrdr_code_t) == 36, "quickrdr_code_t size mismatch");
+
 typedef struct
 {
     uint16_t glyph_id;
@@ -37,27 +116,147 @@ typedef struct
     char name[16];
 } quickrdr_book_t;
 
+// reads the glyph stream of a version 3 or later book
+typedef struct
+{
+    uint24_t block;
+    uint24_t address;    // address of `start`
+    const uint8_t *start; // start of the block
+    const uint8_t *data;  // next glyph ID
+    const uint8_t *end;   // end of the block
+    uint8_t bit;          // version 6: bits of *data already read
+    uint16_t ordinal;     // version 6: glyph IDs read from the block
+    uint16_t count;       // version 6: glyph IDs in the block
+} quickrdr_cursor_t;
+
+typedef struct
+{
+    uint24_t address;     // address of the first record
+    uint24_t first_count; // records stored in the chunk of the first record
+    uint24_t per_chunk;   // records stored in each following chunk
+} quickrdr_table_t;
+
+// codes of up to QUICKRDR_LOOKUP_BITS bits are decoded with one table lookup
+#define QUICKRDR_LOOKUP_BITS 8
+
+// decodes the stream of a version 6 book, built by quickrdr_open_book()
+typedef struct
+{
+    uint8_t length[1 << QUICKRDR_LOOKUP_BITS];    // of the code these bits start, 0 if longer
+    uint16_t glyph_id[1 << QUICKRDR_LOOKUP_BITS]; // of that code
+    // for longer codes, by length: the first code, its symbol and the number of codes
+    uint16_t first_code[QUICKRDR_MAX_CODE_LENGTH + 1];
+    uint24_t first_symbol[QUICKRDR_MAX_CODE_LENGTH + 1];
+    uint16_t count[QUICKRDR_MAX_CODE_LENGTH + 1];
+    quickrdr_table_t symbol_table;
+} quickrdr_decoder_t;
+
 struct quickrdr_book_handle
 {
     quickrdr_header_t header;
     uint24_t cur_offset;
     char filename[9];
+    uint8_t chunk_count;
     const uint8_t *chunk_pointer[100];
+    uint16_t chunk_size[100];       // version 2
+    quickrdr_table_t page_table;    // version 2
+    quickrdr_table_t glyph_table;   // version 2
+    quickrdr_glyph_t *glyph_buffer; // version 1 glyphs are copied here
+    quickrdr_code_t code;           // version 6
+    quickrdr_decoder_t *decoder;    // version 6
 };
 typedef struct quickrdr_book_handle *quickrdr_book_handle_t;
 
+// the glyphs of a version 2 or later book stored in one appvar
+typedef struct
+{
+    uint24_t first;          // index of the first glyph
+    const uint8_t *records;  // the first glyph in the archive
+} quickrdr_glyph_run_t;
+
+// where the glyph table is, for textmode_draw_line() (src/textmode_line.asm)
+typedef struct
+{
+    uint8_t min_extension_byte;
+    uint16_t glyph_size;
+    uint24_t glyph_count;
+    quickrdr_glyph_run_t runs[100 + 1]; // ends with first = 0xFFFFFF
+} quickrdr_font_t;
+
+static_assert(offsetof(quickrdr_font_t, runs) == 6, "quickrdr_font_t layout mismatch");
+
 unsigned int quickrdr_list_files(quickrdr_book_t *book_list, unsigned int offset, unsigned int count);
 unsigned int quickrdr_count_files(void);
 
 quickrdr_book_handle_t quickrdr_open_book(const char *filename);
+/**
+ * Hashes the header of a book and, for version 2 and later books, the size
+ * (and hash) of every appvar, without opening it.
+ * @returns a hash that changes when the book is replaced, 0 if it is missing
+ */
+uint32_t quickrdr_book_identity(const char *filename);
 void quickrdr_close_book(quickrdr_book_handle_t book);
 /**
  * @returns 1 on success, 0 on failure
  */
 uint8_t quickrdr_read_glyph(quickrdr_book_handle_t book, uint16_t glyph_id, quickrdr_glyph_t *glyph);
+/**
+ * @returns pointer to the glyph in the archive, NULL on failure. For version 1
+ * books the glyph is copied into a buffer that the next call overwrites.
+ */
+const quickrdr_glyph_t *quickrdr_get_glyph(quickrdr_book_handle_t book, uint16_t glyph_id);
 uint24_t quickrdr_get_page_size(quickrdr_book_handle_t book, uint24_t page);
 uint24_t quickrdr_read_page(quickrdr_book_handle_t book, uint24_t page, uint8_t *data);
-uint8_t quickrdr_next_char(quickrdr_book_handle_t book, uint8_t *data, uint16_t *glyph_id);
+/**
+ * @returns pointer to the page data in the archive, or NULL if the page must
+ * be copied with quickrdr_read_page() (version 1 pages split between appvars)
+ */
+const uint8_t *quickrdr_get_page(quickrdr_book_handle_t book, uint24_t page, uint24_t *size);
+uint8_t quickrdr_next_char(quickrdr_book_handle_t book, const uint8_t *data, uint16_t *glyph_id);
+/**
+ * Finds where each line of a page starts, lines are separated by glyph ID 0.
+ * @returns number of lines found, at most max_lines
+ */
+uint8_t quickrdr_index_lines(quickrdr_book_handle_t book, const uint8_t *data, uint24_t size, uint24_t *line_start, uint8_t max_lines);
 void quickrdr_get_book_filename(quickrdr_book_handle_t book, char *filename);
+/**
+ * @returns position of the glyph in the glyph table
+ */
+uint24_t quickrdr_glyph_index(quickrdr_book_handle_t book, uint16_t glyph_id);
+/**
+ * Finds the glyph table in the archive.
+ * @returns 1 on success, 0 for version 1 books, whose glyphs are not in the archive
+ */
+uint8_t quickrdr_get_font(quickrdr_book_handle_t book, quickrdr_font_t *font);
+/**
+ * @returns bits per pixel of the glyph bitmaps, 1 or 2
+ */
+uint8_t quickrdr_glyph_bpp(quickrdr_book_handle_t book);
+
+/**
+ * Moves a cursor to the start of the stream.
+ * @returns 1 on success, 0 if the stream is empty
+ */
+uint8_t quickrdr_cursor_begin(quickrdr_book_handle_t book, quickrdr_cursor_t *cursor);
+/**
+ * Moves a cursor to a stream position, an address of a glyph ID within a
+ * block (QUICKRDR_CODED_POSITION() in version 6 books) or QUICKRDR_STREAM_END.
+ * In version 6 books this decodes the block up to the position.
+ * @returns 1 on success, 0 if the address is not in the stream
+ */
+uint8_t quickrdr_cursor_seek(quickrdr_book_handle_t book, quickrdr_cursor_t *cursor, uint24_t address);
+/**
+ * Moves a cursor to the start of block `block` of the stream.
+ * @returns 1 on success, 0 if there is no such block
+ */
+uint8_t quickrdr_cursor_seek_block(quickrdr_book_handle_t book, quickrdr_cursor_t *cursor, uint24_t block);
+/**
+ * @returns 1 and the next glyph ID, or 0 at the end of the stream
+ */
+uint8_t quickrdr_cursor_next(quickrdr_book_handle_t book, quickrdr_cursor_t *cursor, uint16_t *glyph_id);
+/**
+ * @returns the stream position of the next glyph ID
+ */
+uint24_t quickrdr_cursor_tell(quickrdr_book_handle_t book, const quickrdr_cursor_t *cursor);
 
 #pragma pack(pop)
@@ -0,0 +1,640 @@
+#include "reflow.h"
+
+#include <fileioc.h>
+#include <debug.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "scratch.h"
+#include "textmode.h"
+
+// pages added to the index by one reflow_index_step()
+#define INDEX_STEP_PAGES 2
+// page starts per index part, so a part is at most 24 KiB
+#define INDEX_PART_PAGES 8192
+// detached pages whose starts are kept, the earlier ones are dropped
+#define DETACHED_PAGES 64
+// blocks before the one holding a resumed position that reflow_resume() looks
+// for a paragraph start in, so that resuming in text without breaks stays cheap
+#define RESUME_BACK_BLOCKS 2
+
+typedef struct
+{
+    char magic[4];      // "QRIX"
+    uint32_t identity;  // quickrdr_book_identity(), the index of a replaced book is rebuilt
+    reflow_settings_t settings;
+    uint8_t complete;   // 1 once the last page is in the index
+    uint24_t count;     // pages in the index
+    uint24_t frontier;  // start of page `count`
+} reflow_index_header_t;
+
+// The header lives in appvar <name>0, the start of each page in parts <name>1,
+// <name>2, ... Only the header and the part that is appended to are kept in
+// RAM; full parts are archived.
+static const char index_part_chars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+#define INDEX_MAX_PARTS (sizeof(index_part_chars) - 2)
+
+static quickrdr_book_handle_t book;
+static reflow_area_t area;
+static uint8_t *widths; // by glyph index, NULL if there was no memory for it
+static bool widths_scratch;
+static char index_name[10];
+static uint8_t index_name_length;
+static uint8_t index_var; // header
+static bool index_writable;
+static reflow_index_header_t index_header;
+static uint8_t read_var; // part last read from
+static uint8_t read_part;
+static uint8_t append_var; // part being appended to
+static uint8_t append_part;
+// where the last page laid out starts and ends, so that paginating forward or
+// laying out that page again does not seek: a seek in a version 6 book decodes
+// its block up to the position
+static quickrdr_cursor_t last_start;
+static quickrdr_cursor_t last_end;
+static bool last_valid;
+// pages laid out by reflow_resume() from a paragraph start, while the index
+// does not reach them
+static uint24_t detached_start[DETACHED_PAGES]; // of page i at i % DETACHED_PAGES
+static uint24_t detached_count;
+static uint24_t detached_frontier; // start of page `detached_count`
+static bool detached_complete;
+
+void reflow_get_area(quickrdr_book_handle_t book, const reflow_settings_t *settings, reflow_area_t *area)
+{
+    if (book->header.version < 3)
+    {
+        area->x = 8;
+        area->y = 32;
+        area->width = 304;
+        area->height = 180;
+        area->line_height = book->header.line_height;
+    }
+    else
+    {
+        area->x = settings->margin;
+        area->y = TEXTMODE_TEXT_Y + settings->margin;
+        area->width = TEXTMODE_WIDTH - 2 * settings->margin;
+        area->height = TEXTMODE_TEXT_HEIGHT - 2 * settings->margin;
+        area->line_height = book->header.line_height + settings->line_spacing;
+    }
+    area->lines = area->line_height ? area->height / area->line_height : 0;
+    if (area->lines == 0)
+    {
+        area->lines = 1;
+    }
+}
+
+// inverse of quickrdr_glyph_index(), see getGlyphID() in website/src/convert/convert.ts
+static uint16_t glyph_id_at(uint24_t index)
+{
+    uint8_t min_extension_byte = book->header.min_extension_byte;
+    if (min_extension_byte == 0 || index + 1 < min_extension_byte)
+    {
+        return index + 1;
+    }
+    uint24_t rest = index + 1 - min_extension_byte;
+    return ((min_extension_byte + (rest >> 8)) << 8) | (rest & 0xFF);
+}
+
+static uint8_t glyph_width(uint16_t glyph_id)
+{
+    if (widths != NULL)
+    {
+        return widths[quickrdr_glyph_index(book, glyph_id)];
+    }
+    const quickrdr_glyph_t *glyph = quickrdr_get_glyph(book, glyph_id);
+    return glyph != NULL ? glyph->width : 0;
+}
+
+static bool index_save_header(void)
+{
+    return index_writable &&
+           ti_Seek(0, SEEK_SET, index_var) != EOF &&
+           ti_Write(&index_header, sizeof(index_header), 1, index_var) == 1;
+}
+
+static uint8_t index_open(uint8_t part, const char *mode)
+{
+    index_name[index_name_length] = index_part_chars[part];
+    return ti_Open(index_name, mode);
+}
+
+static uint8_t index_create(void)
+{
+    index_var = index_open(0, "w");
+    if (index_var == 0)
+    {
+        return 0;
+    }
+    index_writable = true;
+    quickrdr_cursor_t cursor;
+    quickrdr_cursor_begin(book, &cursor);
+    index_header.count = 0;
+    index_header.frontier = quickrdr_cursor_tell(book, &cursor);
+    index_header.complete = index_header.frontier == QUICKRDR_STREAM_END;
+    return index_save_header();
+}
+
+uint8_t reflow_open(quickrdr_book_handle_t book_handle, const reflow_settings_t *settings, const char *name)
+{
+    book = book_handle;
+    last_valid = false;
+    detached_count = 0;
+    detached_complete = true;
+    index_name_length = strlen(name);
+    memcpy(index_name, name, index_name_length);
+    index_name[index_name_length + 1] = '\0';
+    read_var = append_var = 0;
+    reflow_get_area(book, settings, &area);
+    // scratch memory holds the widths of all but the largest CJK fonts, the
+    // heap those, and without memory for them glyph_width() looks up each glyph
+    widths_scratch = false;
+    widths = NULL;
+    if (book->header.font_glyph_count <= SCRATCH_SIZE)
+    {
+        widths = scratch_alloc();
+        widths_scratch = widths != NULL;
+    }
+    if (widths == NULL)
+    {
+        widths = malloc(book->header.font_glyph_count);
+    }
+    if (widths != NULL)
+    {
+        for (uint24_t i = 0; i < book->header.font_glyph_count; i++)
+        {
+            const quickrdr_glyph_t *glyph = quickrdr_get_glyph(book, glyph_id_at(i));
+            widths[i] = glyph != NULL ? glyph->width : 0;
+        }
+    }
+
+    char filename[10];
+    quickrdr_get_book_filename(book, filename);
+    uint32_t identity = quickrdr_book_identity(filename);
+    index_var = index_open(0, "r");
+    bool valid = index_var != 0 &&
+                 ti_Read(&index_header, sizeof(index_header), 1, index_var) == 1 &&
+                 memcmp(index_header.magic, "QRIX", 4) == 0 &&
+                 index_header.identity == identity &&
+                 memcmp(&index_header.settings, settings, sizeof(*settings)) == 0;
+    index_writable = false;
+    if (valid && !index_header.complete)
+    {
+        // the index grows while reading, so it is kept in RAM until reflow_close()
+        if (ti_IsArchived(index_var))
+        {
+            ti_SetArchiveStatus(false, index_var);
+        }
+        ti_Close(index_var);
+        index_var = index_open(0, "r+");
+        index_writable = index_var != 0;
+        valid = index_writable;
+    }
+    if (!valid)
+    {
+        if (index_var != 0)
+        {
+            ti_Close(index_var);
+        }
+        memcpy(index_header.magic, "QRIX", 4);
+        index_header.identity = identity;
+        index_header.settings = *settings;
+        if (!index_create())
+        {
+            dbg_printf("Failed to create page index %s\n", index_name);
+            reflow_close();
+            return 0;
+        }
+    }
+    dbg_printf("Page index %s: %u pages, complete %u\n", index_name, index_header.count, index_header.complete);
+    return 1;
+}
+
+void reflow_close(void)
+{
+    if (read_var != 0)
+    {
+        ti_Close(read_var);
+        read_var = 0;
+    }
+    if (append_var != 0)
+    {
+        ti_SetArchiveStatus(true, append_var);
+        ti_Close(append_var);
+        append_var = 0;
+    }
+    if (index_var != 0)
+    {
+        if (index_writable)
+        {
+            index_save_header();
+            ti_SetArchiveStatus(true, index_var);
+        }
+        ti_Close(index_var);
+        index_var = 0;
+    }
+    if (widths_scratch)
+    {
+        scratch_free(widths);
+    }
+    else
+    {
+        free(widths);
+    }
+    widths = NULL;
+    book = NULL;
+}
+
+// lays out the line at the cursor and moves the cursor past it, appending its
+// glyph IDs to `data` (if not NULL) at *length, after a 0 with `separate`
+// @returns 1 for a line, 0 at the end of the stream
+static uint8_t layout_line(quickrdr_cursor_t *cursor, uint8_t *data, uint24_t *length, bool separate)
+{
+#define PUT(byte)                   \
+    do                              \
+    {                               \
+        if (data != NULL)           \
+        {                           \
+            data[*length] = (byte); \
+        }                           \
+        (*length)++;                \
+    } while (0)
+    unsigned int width = 0;
+    bool open = false;
+    for (;;)
+    {
+        quickrdr_cursor_t before = *cursor;
+        uint16_t glyph_id;
+        if (!quickrdr_cursor_next(book, cursor, &glyph_id))
+        {
+            break;
+        }
+        uint8_t glyph_w = glyph_id ? glyph_width(glyph_id) : 0;
+        if (glyph_id && open && width + glyph_w > area.width)
+        {
+            // the glyph starts the next line
+            *cursor = before;
+            break;
+        }
+        if (!open)
+        {
+            if (separate)
+            {
+                PUT(0);
+            }
+            open = true;
+        }
+        if (glyph_id == 0)
+        {
+            break;
+        }
+        if (glyph_id > 0xFF)
+        {
+            PUT(glyph_id >> 8);
+        }
+        PUT(glyph_id & 0xFF);
+        width += glyph_w;
+    }
+#undef PUT
+    return open;
+}
+
+uint8_t reflow_page(uint24_t start, uint8_t *data, uint24_t *size, uint24_t *next)
+{
+    quickrdr_cursor_t cursor;
+    *size = 0;
+    *next = QUICKRDR_STREAM_END;
+    if (last_valid && quickrdr_cursor_tell(book, &last_end) == start)
+    {
+        cursor = last_end;
+    }
+    else if (last_valid && quickrdr_cursor_tell(book, &last_start) == start)
+    {
+        cursor = last_start;
+    }
+    else if (!quickrdr_cursor_seek(book, &cursor, start))
+    {
+        return 0;
+    }
+    quickrdr_cursor_t page_start = cursor;
+    uint8_t lines = 0;
+    uint24_t length = 0;
+    while (lines < area.lines && layout_line(&cursor, data, &length, lines != 0))
+    {
+        lines++;
+    }
+    *size = length;
+    *next = quickrdr_cursor_tell(book, &cursor);
+    last_start = page_start;
+    last_end = cursor;
+    last_valid = true;
+    return lines;
+}
+
+static uint8_t index_read(uint24_t page, uint24_t *start)
+{
+    uint8_t part = 1 + page / INDEX_PART_PAGES;
+    uint8_t var = append_var;
+    if (append_var == 0 || part != append_part)
+    {
+        if (read_var == 0 || part != read_part)
+        {
+            if (read_var != 0)
+            {
+                ti_Close(read_var);
+            }
+            read_var = index_open(part, "r");
+            read_part = part;
+        }
+        var = read_var;
+    }
+    return var != 0 &&
+           ti_Seek((page % INDEX_PART_PAGES) * sizeof(uint24_t), SEEK_SET, var) != EOF &&
+           ti_Read(start, sizeof(uint24_t), 1, var) == 1;
+}
+
+// opens the part that page `count` is appended to
+static uint8_t index_append_var(void)
+{
+    uint8_t part = 1 + index_header.count / INDEX_PART_PAGES;
+    if (append_var != 0 && part == append_part)
+    {
+        return append_var;
+    }
+    if (part > INDEX_MAX_PARTS)
+    {
+        return 0;
+    }
+    if (append_var != 0)
+    {
+        // the previous part is full
+        ti_SetArchiveStatus(true, append_var);
+        ti_Close(append_var);
+    }
+    if (read_var != 0 && part == read_part)
+    {
+        ti_Close(read_var);
+        read_var = 0;
+    }
+    if (index_header.count % INDEX_PART_PAGES == 0)
+    {
+        append_var = index_open(part, "w");
+    }
+    else
+    {
+        append_var = index_open(part, "r");
+        if (append_var != 0)
+        {
+            if (ti_IsArchived(append_var))
+            {
+                ti_SetArchiveStatus(false, append_var);
+            }
+            ti_Close(append_var);
+            append_var = index_open(part, "r+");
+        }
+    }
+    append_part = part;
+    return append_var;
+}
+
+// lays out the page at the frontier and appends its start to the index
+static uint8_t index_extend(void)
+{
+    if (index_header.complete || !index_writable)
+    {
+        return 0;
+    }
+    uint24_t size;
+    uint24_t next;
+    if (!reflow_page(index_header.frontier, NULL, &size, &next))
+    {
+        index_header.complete = 1;
+        return 0;
+    }
+    uint8_t var = index_append_var();
+    if (var == 0 ||
+        ti_Seek((index_header.count % INDEX_PART_PAGES) * sizeof(uint24_t), SEEK_SET, var) == EOF ||
+        ti_Write(&index_header.frontier, sizeof(uint24_t), 1, var) != 1)
+    {
+        dbg_printf("Failed to grow the page index\n");
+        return 0;
+    }
+    index_header.count++;
+    index_header.frontier = next;
+    index_header.complete = next == QUICKRDR_STREAM_END;
+    return 1;
+}
+
+// lays out the detached page at the frontier
+static uint8_t detached_extend(void)
+{
+    if (detached_complete)
+    {
+        return 0;
+    }
+    uint24_t size;
+    uint24_t next;
+    if (!reflow_page(detached_frontier, NULL, &size, &next))
+    {
+        detached_complete = true;
+        return 0;
+    }
+    detached_start[detached_count % DETACHED_PAGES] = detached_frontier;
+    detached_count++;
+    detached_frontier = next;
+    detached_complete = next == QUICKRDR_STREAM_END;
+    return 1;
+}
+
+uint8_t reflow_page_start(uint24_t page, uint24_t *start)
+{
+    if (page >= REFLOW_DETACHED_PAGE)
+    {
+        page -= REFLOW_DETACHED_PAGE;
+        while (page >= detached_count && detached_extend())
+        {
+        }
+        if (page >= detached_count || detached_count - page > DETACHED_PAGES)
+        {
+            return 0;
+        }
+        *start = detached_start[page % DETACHED_PAGES];
+        return 1;
+    }
+    if (page >= index_header.count)
+    {
+        while (page >= index_header.count && index_extend())
+        {
+        }
+        index_save_header();
+    }
+    return page < index_header.count && index_read(page, start);
+}
+
+uint24_t reflow_find_page(uint24_t position)
+{
+    if (!index_header.complete && index_header.frontier <= position)
+    {
+        while (index_header.frontier <= position && index_extend())
+        {
+        }
+        index_save_header();
+    }
+    // last page that starts at or before the position
+    uint24_t low = 0;
+    uint24_t high = index_header.count;
+    while (high - low > 1)
+    {
+        uint24_t mid = low + (high - low) / 2;
+        uint24_t start;
+        if (index_read(mid, &start) && start <= position)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// moves the cursor to a paragraph start at or before `position`: the glyph
+// after the last paragraph break before it, looked for in its block and then
+// in up to RESUME_BACK_BLOCKS earlier blocks, each scanned once. Without a
+// break in those, the start of the earliest one stands in for a line start.
+static uint8_t paragraph_start(uint24_t position, quickrdr_cursor_t *cursor)
+{
+    quickrdr_cursor_t scan;
+    if (!quickrdr_cursor_seek(book, &scan, position))
+    {
+        return 0;
+    }
+    uint24_t block = scan.block;
+    for (uint8_t back = 0;; back++)
+    {
+        if (!quickrdr_cursor_seek_block(book, &scan, block))
+        {
+            return 0;
+        }
+        bool found = false;
+        uint16_t glyph_id;
+        // a break that ends the block leaves the scan in the next one
+        while (scan.block == block && quickrdr_cursor_tell(book, &scan) < position &&
+               quickrdr_cursor_next(book, &scan, &glyph_id))
+        {
+            if (glyph_id == 0 && quickrdr_cursor_tell(book, &scan) <= position)
+            {
+                *cursor = scan;
+                found = true;
+            }
+        }
+        if (found)
+        {
+            return 1;
+        }
+        if (block == 0)
+        {
+            return quickrdr_cursor_begin(book, cursor);
+        }
+        if (back == RESUME_BACK_BLOCKS)
+        {
+            return quickrdr_cursor_seek_block(book, cursor, block);
+        }
+        block--;
+    }
+}
+
+uint8_t reflow_resume(uint24_t position, uint24_t *page)
+{
+    detached_count = 0;
+    detached_complete = true;
+    if (index_header.complete || index_header.frontier > position)
+    {
+        *page = reflow_find_page(position);
+        return 1;
+    }
+    quickrdr_cursor_t cursor;
+    if (!paragraph_start(position, &cursor))
+    {
+        return 0;
+    }
+    detached_frontier = quickrdr_cursor_tell(book, &cursor);
+    detached_complete = detached_frontier == QUICKRDR_STREAM_END;
+    // the last detached page that starts at or before the position
+    while (detached_extend() && detached_frontier <= position)
+    {
+    }
+    if (detached_count == 0)
+    {
+        return 0;
+    }
+    *page = REFLOW_DETACHED_PAGE + detached_count - 1;
+    dbg_printf("Resumed at detached page %u of %u\n", detached_count - 1, position);
+    return 1;
+}
+
+uint8_t reflow_attach(uint24_t *page, uint8_t *line, bool wait)
+{
+    uint24_t start;
+    if (*page < REFLOW_DETACHED_PAGE || !reflow_page_start(*page, &start) ||
+        (!wait && !index_header.complete && index_header.frontier <= start))
+    {
+        return 0;
+    }
+    uint24_t index_page = reflow_find_page(start);
+    uint24_t index_start;
+    quickrdr_cursor_t cursor;
+    if (!reflow_page_start(index_page, &index_start) || !quickrdr_cursor_seek(book, &cursor, index_start))
+    {
+        return 0;
+    }
+    // lines after a paragraph start do not depend on where the page started,
+    // so the detached page starts at a line of the index page
+    uint8_t lines = 0;
+    uint24_t length = 0;
+    while (quickrdr_cursor_tell(book, &cursor) < start && layout_line(&cursor, NULL, &length, false))
+    {
+        lines++;
+    }
+    if (quickrdr_cursor_tell(book, &cursor) != start)
+    {
+        if (lines == 0)
+        {
+            return 0;
+        }
+        // laid out from a block start (see paragraph_start()), the detached
+        // page starts inside a line of the index page, so show that line
+        dbg_printf("Detached page at %u is inside line %u of page %u\n", start, lines - 1, index_page);
+        lines--;
+    }
+    *page = index_page;
+    *line = lines;
+    detached_count = 0;
+    detached_complete = true;
+    return 1;
+}
+
+void reflow_index_step(void)
+{
+    for (uint8_t i = 0; i < INDEX_STEP_PAGES; i++)
+    {
+        if (!index_extend())
+        {
+            break;
+        }
+    }
+    index_save_header();
+}
+
+uint24_t reflow_index_count(void)
+{
+    return index_header.count;
+}
+
+bool reflow_index_complete(void)
+{
+    return index_header.complete;
+}
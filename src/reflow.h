@@ -0,0 +1,90 @@
+// Pagination of version 3 and later (reflowable) books on the calculator
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "quickrdr.h"
+
+typedef struct
+{
+    uint8_t margin;       // pixels around the text area
+    uint8_t line_spacing; // pixels between lines
+} reflow_settings_t;
+
+typedef struct
+{
+    unsigned int x;
+    uint8_t y;
+    unsigned int width;
+    uint8_t height;
+    uint8_t line_height; // including line spacing
+    uint8_t lines;       // lines per page
+} reflow_area_t;
+
+/**
+ * The text area of a book. Only version 3 and later books follow the settings, older
+ * ones were paginated for 304x180 pixels by the converter.
+ */
+void reflow_get_area(quickrdr_book_handle_t book, const reflow_settings_t *settings, reflow_area_t *area);
+
+/**
+ * Prepares paginating `book` and opens (or creates) its page index for these
+ * settings, appvars named `index_name` (7 characters at most) followed by a
+ * digit or letter that stay in the archive between sessions. There is only
+ * one reflowed book at a time.
+ * @returns 1 on success, 0 on failure
+ */
+uint8_t reflow_open(quickrdr_book_handle_t book, const reflow_settings_t *settings, const char *index_name);
+void reflow_close(void);
+
+/**
+ * Lays out the page that starts at stream position `start`, the same way
+ * for every start position: lines are filled glyph by glyph, a glyph that
+ * does not fit starts the next line and glyph ID 0 ends a paragraph.
+ * `data` receives the glyph IDs of the page with 0 between lines, like the
+ * pages of older books; pass NULL to only measure it.
+ * @returns number of lines, 0 at the end of the book
+ */
+uint8_t reflow_page(uint24_t start, uint8_t *data, uint24_t *size, uint24_t *next);
+
+// pages laid out by reflow_resume() are numbered from here
+#define REFLOW_DETACHED_PAGE 0x800000
+
+/**
+ * Finds where a page starts, paginating synchronously up to it if the index
+ * does not reach it yet.
+ * @returns 1 on success, 0 if the book has fewer pages
+ */
+uint8_t reflow_page_start(uint24_t page, uint24_t *start);
+/**
+ * @returns the page that contains stream position `position`, paginating
+ * synchronously up to it if needed
+ */
+uint24_t reflow_find_page(uint24_t position);
+/**
+ * Finds the page to resume reading at `position` without paginating up to
+ * it: an index page if the index reaches the position, otherwise a detached
+ * page, laid out from a paragraph start a few blocks before it at most, or
+ * from the start of the earliest of those blocks. Detached pages are
+ * numbered from REFLOW_DETACHED_PAGE and reflow_page_start() finds them too,
+ * until the next reflow_resume() or reflow_attach().
+ * @returns 1 and the page, 0 on failure
+ */
+uint8_t reflow_resume(uint24_t position, uint24_t *page);
+/**
+ * Turns detached page `*page` into the index page it starts in and `*line`,
+ * the line of that page it starts at (or in), once the index reaches it. With
+ * `wait`, paginates synchronously up to it instead.
+ * @returns 1 if the page was attached, 0 if not (yet)
+ */
+uint8_t reflow_attach(uint24_t *page, uint8_t *line, bool wait);
+/**
+ * Adds a few pages to the index, meant to be called while the reader is idle.
+ */
+void reflow_index_step(void);
+/**
+ * @returns pages in the index, the page count once reflow_index_complete()
+ */
+uint24_t reflow_index_count(void);
+bool reflow_index_complete(void);
@@ -0,0 +1,58 @@
+#include "scratch.h"
+
+#include <debug.h>
+
+#include <stddef.h>
+#include <string.h>
+
+// pixelShadow from ti84pce.inc. pixelShadow2 through saveSScreen
+// (0xD052C6-0xD13FD8) hold the BSS and heap of the C toolchain.
+#define SCRATCH_AREA ((uint8_t *)0xD031F6)
+
+static bool claimed;
+static bool used;
+
+void scratch_begin(void)
+{
+    claimed = true;
+    used = false;
+}
+
+void scratch_end(void)
+{
+    if (used)
+    {
+        dbg_printf("Scratch memory was not freed\n");
+    }
+    memset(SCRATCH_AREA, 0, SCRATCH_SIZE);
+    claimed = false;
+}
+
+void *scratch_alloc(void)
+{
+    if (!claimed || used)
+    {
+        dbg_printf("Scratch memory is in use\n");
+        return NULL;
+    }
+    used = true;
+    return SCRATCH_AREA;
+}
+
+void scratch_free(void *area)
+{
+    if (area == NULL)
+    {
+        return;
+    }
+    if (area != SCRATCH_AREA)
+    {
+        dbg_printf("%p is not scratch memory\n", area);
+        return;
+    }
+    if (!used)
+    {
+        dbg_printf("Scratch memory freed twice\n");
+    }
+    used = false;
+}
@@ -0,0 +1,26 @@
+// pixelShadow, an OS RAM area that is unused while the program runs, for a
+// table that would not fit in the C heap
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SCRATCH_SIZE 8400
+
+/**
+ * Claims the OS area.
+ */
+void scratch_begin(void);
+/**
+ * Clears the OS area again, as the OS expects it on exit. It must have been
+ * freed.
+ */
+void scratch_end(void);
+
+/**
+ * The other screen-sized OS areas hold the BSS and heap of the C toolchain,
+ * so there is only this one and every caller must work without it.
+ * @returns SCRATCH_SIZE bytes, or NULL if they are in use
+ */
+void *scratch_alloc(void);
+void scratch_free(void *area);
@@ -0,0 +1,429 @@
+#include "textmode.h"
+
+#include <graphx.h>
+#include <debug.h>
+
+#include <string.h>
+
+#include "gfx/gfx.h"
+
+// PL111 LCD controller registers
+#define LCD_RAM ((uint8_t *)0xD40000)
+#define LCD_UPBASE (*(volatile uint24_t *)0xE30010)
+#define LCD_CONTROL (*(volatile uint24_t *)0xE30018)
+#define LCD_RIS (*(volatile uint8_t *)0xE30020)
+#define LCD_ICR (*(volatile uint8_t *)0xE30028)
+#define LCD_PALETTE ((volatile uint16_t *)0xE30200)
+
+#define LCD_CONTROL_BPP_MASK (7 << 1)
+#define LCD_CONTROL_BPP1 (0 << 1)
+#define LCD_CONTROL_BPP2 (1 << 1)
+#define LCD_CONTROL_BEPO (1 << 10) // first pixel in the MSB, like glyph bitmaps
+#define LCD_INT_LNBU (1 << 2)
+
+#define GFX_BUFFER_SIZE (320 * 240)
+
+// slots at 1bpp, see textmode_begin() for 2bpp
+#define CACHE_SLOT_SIZE (TEXTMODE_STRIDE * TEXTMODE_TEXT_HEIGHT)
+#define CACHE_SLOTS ((GFX_BUFFER_SIZE - 2 * TEXTMODE_BUFFER_SIZE) / CACHE_SLOT_SIZE)
+
+// 2bpp: for each pixel shift s, 256 bytes of `byte >> 2s` followed by 256
+// bytes of the pixels shifted out, `byte << (8 - 2s)`. They follow the two
+// buffers in VRAM, where textmode_line.asm can count on each pair of tables
+// starting at a multiple of 512.
+#define GRAY_LUT_SIZE (4 * 512)
+static_assert((GFX_BUFFER_SIZE + 2 * 2 * TEXTMODE_BUFFER_SIZE) % 512 == 0, "shift tables must be 512-byte aligned");
+
+static bool active;
+static uint8_t bpp;
+static uint8_t stride;            // bytes per row
+static unsigned int buffer_size;
+static unsigned int slot_size;    // text area in a cache slot
+static uint8_t *gray_lut;
+static uint24_t saved_control;
+static uint16_t saved_palette[4];
+static uint8_t *front;
+static uint8_t *back;
+static uint8_t *cache[CACHE_SLOTS];
+static uint24_t cache_keys[CACHE_SLOTS]; // key + 1, 0 for an empty slot
+static uint8_t cache_count;
+static uint8_t cache_next;
+
+#ifndef QUICKRDR_C_DRAW
+// textmode_line.asm
+uint8_t textmode_draw_ids(uint8_t *dst, uint8_t shift, unsigned int room, const uint8_t *data, const uint8_t *end,
+                          const quickrdr_font_t *font, const uint8_t *lut);
+#endif
+
+static void build_gray_lut(void)
+{
+    for (uint8_t shift = 0; shift < 4; shift++)
+    {
+        uint8_t *in = gray_lut + shift * 512;
+        uint8_t *out = in + 256;
+        uint8_t byte = 0;
+        do
+        {
+            in[byte] = byte >> (2 * shift);
+            out[byte] = byte << (8 - 2 * shift);
+        } while (++byte);
+    }
+}
+
+void textmode_begin(uint8_t depth, const uint8_t *colors)
+{
+    if (active)
+    {
+        return;
+    }
+    bpp = depth;
+    stride = TEXTMODE_STRIDE * bpp;
+    buffer_size = TEXTMODE_BUFFER_SIZE * bpp;
+    slot_size = stride * TEXTMODE_TEXT_HEIGHT;
+    // use the graphx buffer that is not being drawn to
+    uint8_t *half = (uint8_t *)gfx_vbuffer == LCD_RAM ? LCD_RAM + GFX_BUFFER_SIZE : LCD_RAM;
+    front = half;
+    back = half + buffer_size;
+    uint8_t *free_vram = half + 2 * buffer_size;
+    if (bpp == 2)
+    {
+        gray_lut = free_vram;
+        build_gray_lut();
+        free_vram += GRAY_LUT_SIZE;
+    }
+    cache_count = (half + GFX_BUFFER_SIZE - free_vram) / slot_size;
+    for (uint8_t i = 0; i < cache_count; i++)
+    {
+        cache[i] = free_vram + i * slot_size;
+    }
+    cache_next = 0;
+    memset(cache_keys, 0, sizeof(cache_keys));
+    memset(front, 0, 2 * buffer_size);
+
+    // 1bpp pixels are 0 and 1, shown as the first and last color
+    uint8_t levels = 1 << bpp;
+    for (uint8_t i = 0; i < levels; i++)
+    {
+        uint8_t color = colors[i == levels - 1 ? 3 : i];
+        saved_palette[i] = LCD_PALETTE[i];
+        LCD_PALETTE[i] = quickrdr_palette[color * 2] | quickrdr_palette[color * 2 + 1] << 8;
+    }
+
+    saved_control = LCD_CONTROL;
+    gfx_Wait();
+    LCD_UPBASE = (uint24_t)front;
+    LCD_CONTROL = (saved_control & ~LCD_CONTROL_BPP_MASK) | (bpp == 2 ? LCD_CONTROL_BPP2 : LCD_CONTROL_BPP1) | LCD_CONTROL_BEPO;
+    active = true;
+    dbg_printf("Text mode on, %ubpp, front %p, %u cache slots\n", bpp, front, cache_count);
+}
+
+void textmode_end(uint8_t background)
+{
+    if (!active)
+    {
+        return;
+    }
+    uint8_t *screen = (uint8_t *)gfx_vbuffer == LCD_RAM ? LCD_RAM + GFX_BUFFER_SIZE : LCD_RAM;
+    memset(screen, background, GFX_BUFFER_SIZE);
+    gfx_Wait();
+    LCD_CONTROL = saved_control;
+    LCD_UPBASE = (uint24_t)screen;
+    for (uint8_t i = 0; i < 1 << bpp; i++)
+    {
+        LCD_PALETTE[i] = saved_palette[i];
+    }
+    cache_count = 0;
+    active = false;
+}
+
+bool textmode_active(void)
+{
+    return active;
+}
+
+uint8_t textmode_bpp(void)
+{
+    return bpp;
+}
+
+uint8_t *textmode_buffer(void)
+{
+    return back;
+}
+
+unsigned int textmode_buffer_size(void)
+{
+    return buffer_size;
+}
+
+void textmode_swap(void)
+{
+    uint8_t *tmp = front;
+    front = back;
+    back = tmp;
+    LCD_ICR = LCD_INT_LNBU;
+    LCD_UPBASE = (uint24_t)front;
+    // the old front buffer may still be scanned out until the base is latched
+    while (!(LCD_RIS & LCD_INT_LNBU))
+    {
+    }
+}
+
+void textmode_blit(void)
+{
+    memcpy(back, front, buffer_size);
+}
+
+void textmode_fill_rows(uint8_t y, uint8_t height, uint8_t value)
+{
+    memset(back + y * stride, value, height * stride);
+}
+
+void textmode_shift_up(uint8_t y, uint8_t height, uint8_t amount)
+{
+    uint8_t *top = back + y * stride;
+    memmove(top, top + amount * stride, (height - amount) * stride);
+    memset(top + (height - amount) * stride, 0, amount * stride);
+}
+
+void textmode_shift_down(uint8_t y, uint8_t height, uint8_t amount)
+{
+    uint8_t *top = back + y * stride;
+    memmove(top + amount * stride, top, (height - amount) * stride);
+    memset(top, 0, amount * stride);
+}
+
+void textmode_pack_rows(const uint8_t *src, uint8_t y, uint8_t height, uint8_t ink)
+{
+    src += y * TEXTMODE_WIDTH;
+    uint8_t *dst = back + y * stride;
+    if (bpp == 2)
+    {
+        // ink becomes pixel value 3
+        for (unsigned int i = height * stride; i; i--)
+        {
+            uint8_t bits = 0;
+            for (uint8_t mask = 0xC0; mask; mask >>= 2)
+            {
+                if (*src++ == ink)
+                {
+                    bits |= mask;
+                }
+            }
+            *dst++ = bits;
+        }
+        return;
+    }
+    for (unsigned int i = height * stride; i; i--)
+    {
+        uint8_t bits = 0;
+        for (uint8_t mask = 0x80; mask; mask >>= 1)
+        {
+            if (*src++ == ink)
+            {
+                bits |= mask;
+            }
+        }
+        *dst++ = bits;
+    }
+}
+
+// 2bpp glyphs have rows padded to whole bytes, each byte is moved into place
+// with the shift tables
+static void draw_gray_glyph(unsigned int x, uint8_t y, const quickrdr_glyph_t *glyph)
+{
+    const uint8_t *in = gray_lut + (x % 4) * 512;
+    const uint8_t *out = in + 256;
+    const uint8_t row_bytes = (glyph->width + 3) / 4;
+    const uint8_t max_bytes = stride - x / 4;
+    uint8_t *row = back + y * stride + x / 4;
+    const uint8_t *src = glyph->data;
+    for (uint8_t i = 0; i < glyph->height && y + i < TEXTMODE_HEIGHT; i++)
+    {
+        for (uint8_t column = 0; column < row_bytes; column++)
+        {
+            uint8_t byte = *src++;
+            if (column < max_bytes)
+            {
+                row[column] |= in[byte];
+                if (column + 1 < max_bytes)
+                {
+                    row[column + 1] |= out[byte];
+                }
+            }
+        }
+        row += stride;
+    }
+}
+
+void textmode_draw_glyph(unsigned int x, uint8_t y, const quickrdr_glyph_t *glyph)
+{
+    if (bpp == 2)
+    {
+        draw_gray_glyph(x, y, glyph);
+        return;
+    }
+    const uint8_t width = glyph->width;
+    const uint8_t shift = x % 8;
+    const uint8_t max_bytes = TEXTMODE_STRIDE - x / 8;
+    uint8_t *row = back + y * TEXTMODE_STRIDE + x / 8;
+    unsigned int src_bit = 0;
+    for (uint8_t i = 0; i < glyph->height && y + i < TEXTMODE_HEIGHT; i++)
+    {
+        uint8_t *dst = row;
+        uint8_t remaining = width;
+        uint8_t column = 0;
+        while (remaining)
+        {
+            // gather the next (up to) 8 source pixels into one byte
+            const uint8_t *src = glyph->data + src_bit / 8;
+            uint8_t offset = src_bit % 8;
+            uint8_t count = remaining < 8 ? remaining : 8;
+            uint8_t bits = *src << offset;
+            if (offset + count > 8)
+            {
+                bits |= src[1] >> (8 - offset);
+            }
+            bits &= 0xFF << (8 - count);
+            if (column < max_bytes)
+            {
+                dst[0] |= bits >> shift;
+                if (shift && column + 1 < max_bytes)
+                {
+                    dst[1] |= bits << (8 - shift);
+                }
+            }
+            dst++;
+            column++;
+            src_bit += count;
+            remaining -= count;
+        }
+        row += TEXTMODE_STRIDE;
+    }
+}
+
+#ifndef QUICKRDR_C_DRAW
+uint8_t textmode_draw_line(unsigned int x, uint8_t y, const uint8_t *data, const uint8_t *end, const quickrdr_font_t *font)
+{
+    if (bpp == 2)
+    {
+        return textmode_draw_ids(back + y * stride + x / 4, x % 4, TEXTMODE_WIDTH - x, data, end, font, gray_lut);
+    }
+    return textmode_draw_ids(back + y * stride + x / 8, x % 8, TEXTMODE_WIDTH - x, data, end, font, NULL);
+}
+#endif
+
+uint8_t textmode_cache_load(uint24_t key)
+{
+    for (uint8_t i = 0; i < cache_count; i++)
+    {
+        if (cache_keys[i] == key + 1)
+        {
+            memcpy(back + TEXTMODE_TEXT_Y * stride, cache[i], slot_size);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void textmode_cache_store(uint24_t key)
+{
+    for (uint8_t i = 0; i < cache_count; i++)
+    {
+        if (cache_keys[i] == key + 1)
+        {
+            return;
+        }
+    }
+    memcpy(cache[cache_next], back + TEXTMODE_TEXT_Y * stride, slot_size);
+    cache_keys[cache_next] = key + 1;
+    if (++cache_next >= cache_count)
+    {
+        cache_next = 0;
+    }
+}
+
+void textmode_cache_forget(uint24_t key)
+{
+    for (uint8_t i = 0; i < cache_count; i++)
+    {
+        if (cache_keys[i] == key + 1)
+        {
+            cache_keys[i] = 0;
+        }
+    }
+}
+
+unsigned int textmode_snapshot_pack(uint8_t *out, unsigned int capacity)
+{
+    const uint8_t *src = back + TEXTMODE_TEXT_Y * stride;
+    const uint8_t *end = src + slot_size;
+    unsigned int size = 0;
+    while (src < end)
+    {
+        unsigned int left = end - src;
+        unsigned int count = 1;
+        while (count < 128 && count < left && src[count] == src[0])
+        {
+            count++;
+        }
+        if (count >= 2)
+        {
+            if (size + 2 > capacity)
+            {
+                return 0;
+            }
+            out[size++] = 257 - count;
+            out[size++] = src[0];
+            src += count;
+            continue;
+        }
+        // copy up to the next pair of equal bytes
+        while (count < 128 && count < left && (count + 1 == left || src[count] != src[count + 1]))
+        {
+            count++;
+        }
+        if (size + 1 + count > capacity)
+        {
+            return 0;
+        }
+        out[size++] = count - 1;
+        memcpy(out + size, src, count);
+        size += count;
+        src += count;
+    }
+    return size;
+}
+
+uint8_t textmode_snapshot_unpack(const uint8_t *data, unsigned int size)
+{
+    uint8_t *dst = back + TEXTMODE_TEXT_Y * stride;
+    const uint8_t *end = dst + slot_size;
+    const uint8_t *data_end = data + size;
+    while (data < data_end)
+    {
+        uint8_t control = *data++;
+        if (control < 128)
+        {
+            unsigned int count = control + 1;
+            if (count > (unsigned int)(data_end - data) || count > (unsigned int)(end - dst))
+            {
+                return 0;
+            }
+            memcpy(dst, data, count);
+            data += count;
+            dst += count;
+        }
+        else
+        {
+            unsigned int count = 257 - control;
+            if (control == 128 || data == data_end || count > (unsigned int)(end - dst))
+            {
+                return 0;
+            }
+            memset(dst, *data++, count);
+            dst += count;
+        }
+    }
+    return dst == end;
+}
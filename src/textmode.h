@@ -0,0 +1,104 @@
+// Reduced-bpp LCD mode used while reading a book
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "quickrdr.h"
+
+#define TEXTMODE_WIDTH 320
+#define TEXTMODE_HEIGHT 240
+// at 1bpp, twice as much at 2bpp
+#define TEXTMODE_STRIDE (TEXTMODE_WIDTH / 8)
+#define TEXTMODE_BUFFER_SIZE (TEXTMODE_STRIDE * TEXTMODE_HEIGHT)
+
+// the part of the screen between the top and bottom bars
+#define TEXTMODE_TEXT_Y 24
+#define TEXTMODE_TEXT_HEIGHT 196
+
+/**
+ * Switches the LCD to 1bpp or 2bpp (`depth`), for books with 1bpp or 2bpp
+ * glyphs. `colors` are 4 entries of quickrdr_palette: the background, two
+ * levels of anti-aliasing and the text; 1bpp only uses the first and last.
+ * Both buffers live in the half of VRAM that graphx is not drawing to, so
+ * graphx can still be used to draw into gfx_vbuffer as scratch (see
+ * textmode_pack_rows()).
+ */
+void textmode_begin(uint8_t depth, const uint8_t *colors);
+/**
+ * Restores the 8bpp graphx mode. The graphx screen buffer is cleared to
+ * `background`, so the caller should redraw everything afterwards.
+ */
+void textmode_end(uint8_t background);
+bool textmode_active(void);
+uint8_t textmode_bpp(void);
+
+/**
+ * @returns the 1bpp buffer that is not on screen
+ */
+uint8_t *textmode_buffer(void);
+unsigned int textmode_buffer_size(void);
+/**
+ * Shows the back buffer and waits until the LCD has picked it up.
+ */
+void textmode_swap(void);
+/**
+ * Copies the screen into the back buffer, like gfx_BlitScreen().
+ */
+void textmode_blit(void);
+
+void textmode_fill_rows(uint8_t y, uint8_t height, uint8_t value);
+/**
+ * Moves rows [y + amount, y + height) up by `amount` rows and clears the
+ * rows that are uncovered at the bottom.
+ */
+void textmode_shift_up(uint8_t y, uint8_t height, uint8_t amount);
+/**
+ * Moves rows [y, y + height - amount) down by `amount` rows and clears the
+ * rows that are uncovered at the top.
+ */
+void textmode_shift_down(uint8_t y, uint8_t height, uint8_t amount);
+/**
+ * Converts rows of an 8bpp buffer (usually gfx_vbuffer) into the back buffer,
+ * pixels of color `ink` become the text color and everything else background.
+ */
+void textmode_pack_rows(const uint8_t *src, uint8_t y, uint8_t height, uint8_t ink);
+/**
+ * ORs a glyph bitmap into the back buffer, 8 pixels at a time at 1bpp and a
+ * byte at a time through shift tables at 2bpp. The glyph must have the bits
+ * per pixel of the mode.
+ */
+void textmode_draw_glyph(unsigned int x, uint8_t y, const quickrdr_glyph_t *glyph);
+/**
+ * Draws the glyph IDs in [data, end) up to the first 0 starting at (x, y),
+ * like quickrdr_next_char(), quickrdr_get_glyph() and textmode_draw_glyph()
+ * in a loop, but in assembly (textmode_line.asm, `make ASM_DRAW=1` only). A
+ * glyph that would cross the right edge ends the line, and the glyphs must
+ * end above TEXTMODE_HEIGHT.
+ * @returns 1 on success, 0 for a glyph ID that is not in the font
+ */
+#ifndef QUICKRDR_C_DRAW
+uint8_t textmode_draw_line(unsigned int x, uint8_t y, const uint8_t *data, const uint8_t *end, const quickrdr_font_t *font);
+#endif
+
+/**
+ * The VRAM freed by the text buffers keeps the text areas of recently
+ * rendered pages. The cache is emptied by textmode_begin().
+ * @returns 1 if the text area of `key` was restored into the back buffer
+ */
+uint8_t textmode_cache_load(uint24_t key);
+void textmode_cache_store(uint24_t key);
+void textmode_cache_forget(uint24_t key);
+
+/**
+ * Codes the text area of the back buffer like PackBits, for a snapshot that
+ * outlives the program: a control byte c < 128 is followed by c + 1 bytes to
+ * copy, c > 128 by one byte to repeat 257 - c times.
+ * @returns size of the coded text area, 0 if it needs more than `capacity` bytes
+ */
+unsigned int textmode_snapshot_pack(uint8_t *out, unsigned int capacity);
+/**
+ * Decodes a text area coded by textmode_snapshot_pack() into the back buffer.
+ * @returns 1 on success, 0 if `size` bytes do not make a text area at the current bpp
+ */
+uint8_t textmode_snapshot_unpack(const uint8_t *data, unsigned int size);
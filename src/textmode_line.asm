@@ -0,0 +1,319 @@
+; Glyph drawing loop of textmode_draw_line(): decodes the glyph IDs of a line,
+; finds each glyph in the archive and ORs its bitmap into the back buffer,
+; without a C call per glyph. Only used by `make ASM_DRAW=1` builds, the C
+; loop in draw_line() (src/main.c) is the default and the reference.
+
+	assume	adl=1
+
+	section	.text
+
+	public	_textmode_draw_ids
+
+	extern	__imulu
+
+; offsets in quickrdr_font_t
+FONT_MIN_EXTENSION_BYTE := 0
+FONT_GLYPH_SIZE := 1
+FONT_GLYPH_COUNT := 3
+FONT_RUNS := 6
+; offsets in quickrdr_glyph_run_t
+RUN_FIRST := 0
+RUN_RECORDS := 3
+RUN_SIZE := 6
+
+; uint8_t textmode_draw_ids(uint8_t *dst, uint8_t shift, unsigned int room,
+;                           const uint8_t *data, const uint8_t *end,
+;                           const quickrdr_font_t *font, const uint8_t *lut);
+; Draws glyphs from byte dst, pixel shift on until glyph ID 0, `end` or a
+; glyph wider than the `room` pixels left. `lut` is NULL for 1bpp, else the
+; 2bpp shift tables. Returns 0 for an ID that is not in the font, 1 otherwise.
+_textmode_draw_ids:
+	push	ix
+	ld	ix,0
+	add	ix,sp
+	ld	hl,(ix+6)
+	ld	(glyph_dst),hl
+	ld	a,(ix+9)
+	ld	(glyph_shift),a
+	ld	hl,(ix+12)
+	ld	(line_room),hl
+	ld	hl,(ix+15)
+	ld	(line_data),hl
+	ld	hl,(ix+18)
+	ld	(line_end),hl
+	ld	hl,(ix+21)
+	ld	(line_font),hl
+	ld	hl,(ix+24)
+	ld	(line_lut),hl
+	ld	a,(ix+26)		; the tables are in VRAM, so 0 only for NULL
+	ld	(line_gray),a
+
+.glyph:
+	ld	hl,(line_data)
+	ld	de,(line_end)
+	or	a,a
+	sbc	hl,de
+	jp	nc,.done
+	add	hl,de
+	ld	ix,(line_font)
+	ld	de,0
+	ld	e,(hl)
+	inc	hl
+	ld	a,e
+	or	a,a
+	jp	z,.done			; paragraph break
+	ld	bc,0
+	ld	c,(ix+FONT_MIN_EXTENSION_BYTE)
+	inc	c
+	dec	c
+	jr	z,.one_byte
+	cp	a,c
+	jr	c,.one_byte
+	; index = ((byte - min_extension_byte) << 8 | next byte) + min_extension_byte - 1,
+	; like quickrdr_glyph_index()
+	sub	a,c
+	ld	d,a
+	ld	e,(hl)
+	inc	hl
+	ld	(line_data),hl
+	ex	de,hl
+	add	hl,bc
+	dec	hl
+	jr	.index
+.one_byte:
+	ld	(line_data),hl
+	ex	de,hl
+	dec	hl
+.index:
+	ld	de,(ix+FONT_GLYPH_COUNT)
+	or	a,a
+	sbc	hl,de
+	jp	nc,.fail
+	add	hl,de
+	ld	c,(ix+FONT_GLYPH_SIZE)
+	ld	b,(ix+FONT_GLYPH_SIZE+1)
+	lea	ix,ix+FONT_RUNS
+.find_run:
+	; the runs end with first = 0xFFFFFF, above any index
+	ld	de,(ix+RUN_SIZE+RUN_FIRST)
+	or	a,a
+	sbc	hl,de
+	jr	c,.found_run
+	add	hl,de
+	lea	ix,ix+RUN_SIZE
+	jr	.find_run
+.found_run:
+	add	hl,de
+	ld	de,(ix+RUN_FIRST)
+	or	a,a
+	sbc	hl,de
+	call	__imulu			; hl = (index - first) * glyph size
+	ld	de,(ix+RUN_RECORDS)
+	add	hl,de			; hl = quickrdr_glyph_t
+
+	inc	hl
+	inc	hl
+	ld	a,(hl)
+	ld	(glyph_width),a
+	inc	hl
+	ex	de,hl
+	ld	hl,(line_room)
+	ld	bc,0
+	ld	c,a
+	or	a,a
+	sbc	hl,bc
+	jp	c,.done			; past the right edge
+	ld	(line_room),hl
+	ex	de,hl
+	ld	a,(hl)
+	inc	hl
+	or	a,a
+	jr	z,.advance
+	ld	(glyph_rows),a
+	ld	a,(glyph_width)
+	or	a,a
+	jr	z,.advance
+	ld	a,(line_gray)
+	or	a,a
+	jp	nz,.gray
+
+	; hl = bitmap, c = its current byte with b bits left, de = destination.
+	; Pixels are shifted into a until it holds a destination byte, ixl counts
+	; the pixels that byte still needs and ixh the pixels left in the row.
+	ld	de,(glyph_dst)
+	ld	c,(hl)
+	inc	hl
+	ld	b,8
+.row:
+	ld	(row_dst),de
+	ld	a,(glyph_shift)
+	neg
+	add	a,8
+	ld	ixl,a
+	ld	a,(glyph_width)
+	ld	ixh,a
+	xor	a,a
+.pixel:
+	sla	c
+	rla
+	djnz	.have_bits
+	ld	c,(hl)
+	inc	hl
+	ld	b,8
+.have_bits:
+	dec	ixl
+	jr	nz,.next_pixel
+	ex	de,hl
+	or	a,(hl)
+	ld	(hl),a
+	inc	hl
+	ex	de,hl
+	ld	ixl,8
+	xor	a,a
+.next_pixel:
+	dec	ixh
+	jr	nz,.pixel
+	; the rest of the row, moved to the top of a
+	push	bc
+	ld	b,ixl
+	bit	3,b
+	jr	nz,.row_done		; nothing left over
+.align:
+	add	a,a
+	djnz	.align
+	ex	de,hl
+	or	a,(hl)
+	ld	(hl),a
+	ex	de,hl
+.row_done:
+	pop	bc
+	push	hl
+	ld	hl,(row_dst)
+	ld	de,40			; TEXTMODE_STRIDE at 1bpp
+	add	hl,de
+	ex	de,hl
+	pop	hl
+	ld	a,(glyph_rows)
+	dec	a
+	ld	(glyph_rows),a
+	jr	nz,.row
+
+.advance:
+	; dst += (shift + width) / pixels per byte, shift = the remainder
+	ld	de,0
+	ld	a,(glyph_width)
+	ld	e,a
+	ld	hl,0
+	ld	a,(glyph_shift)
+	ld	l,a
+	add	hl,de
+	ld	a,(line_gray)
+	or	a,a
+	ld	a,l
+	jr	nz,.advance_gray
+	and	a,7
+	ld	(glyph_shift),a
+	srl	h
+	rr	l
+	jr	.advance_bytes
+.advance_gray:
+	and	a,3
+	ld	(glyph_shift),a
+.advance_bytes:
+	srl	h
+	rr	l
+	srl	h
+	rr	l
+	ld	de,(glyph_dst)
+	add	hl,de
+	ld	(glyph_dst),hl
+	jp	.glyph
+
+.gray:
+	; hl = bitmap, rows padded to whole bytes. bc = the tables for
+	; glyph_shift: (bc) with c = a bitmap byte is the part that lands in the
+	; destination byte, (bc + 256) the part that spills into the next one.
+	ld	a,(glyph_width)
+	dec	a
+	srl	a
+	srl	a
+	inc	a
+	ld	(glyph_row_bytes),a
+	push	hl
+	ld	hl,0
+	ld	a,(glyph_shift)
+	add	a,a
+	ld	h,a			; hl = shift * 512
+	ld	bc,(line_lut)
+	add	hl,bc
+	push	hl
+	pop	bc
+	pop	hl
+	ld	de,(glyph_dst)
+.gray_row:
+	ld	(row_dst),de
+	ld	a,(glyph_row_bytes)
+	ld	ixh,a
+.gray_byte:
+	ld	c,(hl)
+	inc	hl
+	ld	a,(bc)
+	ex	de,hl
+	or	a,(hl)
+	ld	(hl),a
+	inc	hl
+	inc	b
+	ld	a,(bc)
+	or	a,(hl)
+	ld	(hl),a
+	dec	b
+	ex	de,hl
+	dec	ixh
+	jr	nz,.gray_byte
+	push	hl
+	ld	hl,(row_dst)
+	ld	de,80			; TEXTMODE_STRIDE at 2bpp
+	add	hl,de
+	ex	de,hl
+	pop	hl
+	ld	a,(glyph_rows)
+	dec	a
+	ld	(glyph_rows),a
+	jr	nz,.gray_row
+	jp	.advance
+
+.done:
+	ld	a,1
+	pop	ix
+	ret
+.fail:
+	xor	a,a
+	pop	ix
+	ret
+
+	section	.data
+
+glyph_dst:
+	dl	0
+glyph_shift:
+	db	0
+glyph_width:
+	db	0
+glyph_rows:
+	db	0
+glyph_row_bytes:
+	db	0
+row_dst:
+	dl	0
+line_room:
+	dl	0
+line_data:
+	dl	0
+line_end:
+	dl	0
+line_font:
+	dl	0
+line_lut:
+	dl	0
+line_gray:
+	db	0
@@ -0,0 +1,276 @@
+#!/usr/bin/env python3
+"""Page-turn benchmark for QUICKRDR.8xp, run in the CEmu autotester.
+
+Builds the program with `make BENCHMARK=1` into out/build, converts the
+fixture books with qrconv and drives the reader through a fixed sequence of
+key presses, once per book. The benchmark build reports the CPU cycles from
+each key press until its page is drawn, and a CRC of the screen, on the CEmu
+debug console. The CRCs are compared against baseline.json and the cycle
+counts are shown next to the baseline ones. With --compare-draw, the screens
+drawn by src/textmode_line.asm (make ASM_DRAW=1) are compared against the
+C loop instead.
+"""
+
+import argparse
+import io
+import json
+import os
+import random
+import re
+import subprocess
+import sys
+import tarfile
+from pathlib import Path
+
+HERE = Path(__file__).resolve().parent
+ROOT = HERE.parent.parent
+OUT = HERE / 'out'
+BASELINE = HERE / 'baseline.json'
+
+# sk_* scan codes, as logged by the program
+KEY_CODES = {'down': 1, 'left': 2, 'right': 3, 'up': 4, 'enter': 9, 'clear': 15}
+
+SAMPLE = re.compile(r'QRBENCH (\d+) (\d+) (\d+) (\d+) (\d+) ([0-9a-f]{8})')
+
+WORDS = ('the of and to in a is that for it as was with be by on not he this are or his from at which but have an '
+         'they you were her she there been one all we their has would when if so no will more said who what up out '
+         'about into than them can only other time new some could these two may first then do any like my now over '
+         'such our man me even most made after also did many before must through back years where much your way').split()
+
+
+def latin_text(length):
+    rng = random.Random(1)
+    paragraphs = []
+    size = 0
+    while size < length:
+        sentences = []
+        for _ in range(rng.randint(2, 8)):
+            words = [rng.choice(WORDS) for _ in range(rng.randint(4, 18))]
+            sentences.append(' '.join(words).capitalize() + '.')
+        paragraphs.append(' '.join(sentences))
+        size += len(paragraphs[-1]) + 1
+    return '\n'.join(paragraphs)
+
+
+# ideographs with a skewed distribution, so both 1 and 2-byte glyph IDs are used
+def cjk_text(length, distinct):
+    rng = random.Random(2)
+    chars = []
+    for i in range(length):
+        if rng.random() < 0.02:
+            chars.append('。\n' if rng.random() < 0.3 else '，')
+            continue
+        rank = int(distinct ** rng.random())
+        chars.append(chr(0x4E00 + rank - 1))
+    return ''.join(chars)
+
+
+# runs of every printable ASCII character and a few CJK ones, so that each
+# glyph width leads to its own sequence of pixel shifts, and lines end as
+# close to the right edge as the glyphs allow
+def edge_text():
+    chars = [chr(c) for c in range(0x21, 0x7F)] + ['\u4E00', '\u9F8D', '\u3002']
+    runs = [char * 16 for char in chars]
+    return '\n'.join(''.join(runs[i:i + 5]) for i in range(0, len(runs), 5))
+
+
+FIXTURES = {
+    'latin': lambda: latin_text(60 * 1024),
+    'cjk': lambda: cjk_text(20 * 1024, 3000),
+    'edge': edge_text,
+}
+
+
+def scenario(pages):
+    """(step name, key) pairs, every key press yields one sample"""
+    steps = [('open book list', 'enter'), ('open book', 'enter')]
+    steps += [('next page %d' % (i + 1), 'right') for i in range(pages)]
+    steps += [('previous page %d' % (i + 1), 'left') for i in range(pages)]
+    # scrolling past the end of the page pulls in the next one
+    steps += [('scroll down %d' % (i + 1), 'down') for i in range(16)]
+    steps += [('scroll up %d' % (i + 1), 'up') for i in range(3)]
+    steps += [('back to menu', 'clear'), ('select continue', 'down'), ('resume', 'enter')]
+    steps += [('next page after resume', 'right'), ('previous page after resume', 'left')]
+    return steps
+
+
+def narrow_margin():
+    """steps that switch to the 4 pixel margin, the last glyphs of a line then
+    land in the last byte of the screen"""
+    return [('settings 1', 'down'), ('settings 2', 'down'), ('open settings', 'enter'), ('margin 4', 'left'),
+            ('save settings', 'clear'), ('open 1', 'up'), ('open 2', 'up')]
+
+
+def run(cmd, **kwargs):
+    print('+', ' '.join(str(arg) for arg in cmd), file=sys.stderr)
+    return subprocess.run(cmd, check=True, **kwargs)
+
+
+def checkout(rev):
+    """the tree of a git revision, to benchmark an older build"""
+    tree = OUT / 'rev' / rev
+    if not tree.exists():
+        archive = subprocess.run(['git', '-C', ROOT, 'archive', rev], check=True, stdout=subprocess.PIPE).stdout
+        tree.mkdir(parents=True)
+        with tarfile.open(fileobj=io.BytesIO(archive)) as tar:
+            tar.extractall(tree)
+    return tree
+
+
+def build(root, variant, flags, rebuild=True):
+    """builds QUICKRDR.8xp into a directory of its own, which only ever sees
+    these flags, so that a normal build in the repository is left alone"""
+    out = OUT / 'build' / variant
+    if rebuild:
+        run(['make', '-C', root, 'BENCHMARK=1', 'OBJDIR=%s' % (out / 'obj'), 'BINDIR=%s' % (out / 'bin')] + flags)
+    return out / 'bin' / 'QUICKRDR.8xp'
+
+
+def build_fixtures(root, font, size, names, variant, options=()):
+    fixtures = OUT / 'fixtures'
+    appvars = OUT / 'appvars' / variant
+    fixtures.mkdir(parents=True, exist_ok=True)
+    appvars.mkdir(parents=True, exist_ok=True)
+    for stale in appvars.glob('*.8xv'):
+        stale.unlink()
+    paths = []
+    for name in names:
+        path = fixtures / (name + '.txt')
+        path.write_text(FIXTURES[name](), encoding='utf-8')
+        paths.append(path)
+    run(['make', '-C', root / 'tools' / 'qrconv'])
+    result = run([root / 'tools' / 'qrconv' / 'qrconv', '-f', font, '-s', str(size), '-o', appvars, *options] + paths,
+                 stdout=subprocess.PIPE, text=True)
+    books = {}
+    for line in result.stdout.splitlines():
+        match = re.match(r'(.*) -> (\w+) ', line)
+        if match:
+            # appvars other than <BASE>00 are named after their contents,
+            # qrconv before the manifests named them <BASE>00, <BASE>01...
+            manifest = appvars / (match.group(2) + '.json')
+            if manifest.exists():
+                appvar_names = [appvar['name'] for appvar in json.loads(manifest.read_text())['appVars']]
+                books[Path(match.group(1)).stem] = [appvars / (name + '.8xv') for name in appvar_names]
+            else:
+                books[Path(match.group(1)).stem] = sorted(appvars.glob(match.group(2) + '*.8xv'))
+    return books
+
+
+def autotest(name, program, appvars, steps, delay):
+    sequence = ['action|launch', 'delay|3000']
+    for _, key in steps:
+        sequence += ['key|' + key, 'delay|%d' % delay]
+    config = {
+        'transfer_files': [str(program)] + [str(path) for path in appvars],
+        'target': {'name': 'QUICKRDR', 'isASM': True},
+        'sequence': sequence,
+        'hashes': {},
+    }
+    path = OUT / (name + '.json')
+    path.write_text(json.dumps(config, indent=2))
+    result = run([os.environ.get('AUTOTESTER', 'autotester'), path], stdout=subprocess.PIPE, text=True)
+    samples = [match.groups() for match in map(SAMPLE.search, result.stdout.splitlines()) if match]
+    if len(samples) != len(steps):
+        sys.exit('%s: got %d samples for %d key presses, try a longer --delay' % (name, len(samples), len(steps)))
+    results = []
+    for (step, key), (_, code, state, page, cycles, crc) in zip(steps, samples):
+        if int(code) != KEY_CODES[key]:
+            sys.exit('%s: sample for "%s" has key %s, try a longer --delay' % (name, step, code))
+        results.append({'step': step, 'state': int(state), 'page': int(page), 'cycles': int(cycles), 'crc': crc})
+    return results
+
+
+def report(results, baseline):
+    failed = 0
+    for name, samples in results.items():
+        print('\n%s' % name)
+        print('%-28s %6s %12s %12s %8s  %s' % ('step', 'page', 'cycles', 'baseline', 'change', 'screen'))
+        old = {sample['step']: sample for sample in baseline.get(name, [])}
+        total = old_total = 0
+        for sample in samples:
+            base = old.get(sample['step'])
+            total += sample['cycles']
+            line = '%-28s %6d %12d' % (sample['step'], sample['page'] + 1, sample['cycles'])
+            if base is None:
+                print(line + '  (no baseline)')
+                continue
+            old_total += base['cycles']
+            change = (sample['cycles'] - base['cycles']) / base['cycles'] * 100 if base['cycles'] else 0
+            same = sample['crc'] == base['crc']
+            failed += not same
+            print(line + ' %12d %+7.1f%%  %s' % (base['cycles'], change, 'ok' if same else 'CHANGED ' + sample['crc']))
+        print('%-28s %6s %12d %12s' % ('total', '', total, old_total or ''))
+    return failed
+
+
+def compare_draw(asm, c):
+    """the screens drawn by the two text loops must not differ"""
+    failed = 0
+    for name, samples in asm.items():
+        for sample, reference in zip(samples, c[name]):
+            if sample['crc'] != reference['crc']:
+                print('%s: "%s" (page %d) is %s, the C loop draws %s' % (name, sample['step'], sample['page'] + 1,
+                                                                        sample['crc'], reference['crc']))
+                failed += 1
+        print('%s: %d screens compared' % (name, len(samples)))
+    return failed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('-f', '--font', required=True, help='font for the fixture books, needs CJK glyphs')
+    parser.add_argument('-s', '--size', type=int, default=16, help='font size in pixels')
+    parser.add_argument('-n', '--pages', type=int, default=10, help='pages to turn forward and back')
+    parser.add_argument('-d', '--delay', type=int, default=2000, help='emulated ms to wait after each key')
+    parser.add_argument('--book', action='append', choices=sorted(FIXTURES), help='only run these fixtures')
+    parser.add_argument('--no-build', action='store_true', help='use the programs built by the last run')
+    mode = parser.add_mutually_exclusive_group()
+    mode.add_argument('--asm-draw', action='store_true', help='draw text with the assembly loop (make ASM_DRAW=1)')
+    mode.add_argument('--compare-draw', action='store_true',
+                      help='compare the screens of the asm and C text loops, for 1bpp and 2bpp books')
+    mode.add_argument('--rev', help='benchmark the program and qrconv of this git revision')
+    parser.add_argument('--update', action='store_true', help='save the results as the new baseline')
+    args = parser.parse_args()
+
+    if 'AUTOTESTER_ROM' not in os.environ:
+        sys.exit('AUTOTESTER_ROM must point to a TI-84 Plus CE ROM image')
+    names = args.book or sorted(FIXTURES)
+    steps = scenario(args.pages)
+    if args.compare_draw:
+        asm = build(ROOT, 'asm', ['ASM_DRAW=1'], not args.no_build)
+        c = build(ROOT, 'c', [], not args.no_build)
+        steps = narrow_margin() + steps
+        failed = 0
+        for bpp, options in (('1bpp', []), ('2bpp', ['-g'])):
+            books = build_fixtures(ROOT, args.font, args.size, names, bpp, options)
+            results = {}
+            for variant, program in (('asm', asm), ('c', c)):
+                results[variant] = {'%s %s' % (name, bpp): autotest('%s-%s-%s' % (name, bpp, variant), program,
+                                                                     appvars, steps, args.delay)
+                                    for name, appvars in books.items()}
+            failed += compare_draw(results['asm'], results['c'])
+        if failed:
+            sys.exit('%d screens differ between the asm and C text loops' % failed)
+        return
+
+    root = checkout(args.rev) if args.rev else ROOT
+    variant = 'rev-' + args.rev if args.rev else 'asm' if args.asm_draw else 'c'
+    program = build(root, variant, ['ASM_DRAW=1'] if args.asm_draw else [], not args.no_build)
+    books = build_fixtures(root, args.font, args.size, names, variant)
+    results = {name: autotest(name, program, appvars, steps, args.delay) for name, appvars in books.items()}
+    (OUT / 'results.json').write_text(json.dumps(results, indent=2))
+
+    if args.update:
+        BASELINE.write_text(json.dumps(results, indent=2) + '\n')
+        print('baseline updated')
+        return
+    if not BASELINE.exists():
+        report(results, {})
+        sys.exit('there is no baseline.json to compare against, record one with --rev 69b656b --update')
+    failed = report(results, json.loads(BASELINE.read_text()))
+    if failed:
+        sys.exit('%d screens differ from the baseline' % failed)
+
+
+if __name__ == '__main__':
+    main()
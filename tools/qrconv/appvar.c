@@ -0,0 +1,174 @@
+#include "appvar.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint8_t file_signature[11] = {'*', '*', 'T', 'I', '8', '3', 'F', '*', 0x1A, 0x0A, 0x0A};
+
+// reads a whole file, NULL if it does not exist
+static uint8_t *read_existing(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+    qrconv_buf_t buf = {0};
+    uint8_t chunk[4096];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    {
+        qrconv_buf_append(&buf, chunk, read);
+    }
+    fclose(file);
+    *size = buf.size;
+    return buf.data;
+}
+
+/**
+ * Writes one appvar, leaving an identical existing file alone.
+ * @returns 1 if the file was written, 0 if it was unchanged, -1 on failure
+ */
+static int write_appvar(const char *path, const char *name, const uint8_t *data, size_t size)
+{
+    // see convertDataToAppVarEntry() in website/src/convert/ti.ts
+    uint8_t entry[19];
+    qrconv_put16(entry, 13);
+    qrconv_put16(entry + 2, size + 2);
+    entry[4] = 0x15; // appvar
+    memset(entry + 5, 0, 8);
+    memcpy(entry + 5, name, strlen(name) < 8 ? strlen(name) : 8);
+    entry[13] = 0;    // version
+    entry[14] = 0x80; // archived
+    qrconv_put16(entry + 15, size + 2);
+    qrconv_put16(entry + 17, size);
+
+    uint8_t header[55] = {0};
+    memcpy(header, file_signature, sizeof(file_signature));
+    qrconv_put16(header + 53, sizeof(entry) + size);
+
+    uint16_t checksum = 0;
+    for (size_t i = 0; i < sizeof(entry); i++)
+    {
+        checksum += entry[i];
+    }
+    for (size_t i = 0; i < size; i++)
+    {
+        checksum += data[i];
+    }
+    uint8_t footer[2];
+    qrconv_put16(footer, checksum);
+
+    qrconv_buf_t contents = {0};
+    qrconv_buf_append(&contents, header, sizeof(header));
+    qrconv_buf_append(&contents, entry, sizeof(entry));
+    qrconv_buf_append(&contents, data, size);
+    qrconv_buf_append(&contents, footer, sizeof(footer));
+
+    size_t existing_size;
+    uint8_t *existing = read_existing(path, &existing_size);
+    int same = existing != NULL && existing_size == contents.size &&
+               memcmp(existing, contents.data, contents.size) == 0;
+    free(existing);
+    if (same)
+    {
+        qrconv_buf_free(&contents);
+        return 0;
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        perror(path);
+        qrconv_buf_free(&contents);
+        return -1;
+    }
+    int ok = fwrite(contents.data, contents.size, 1, file) == 1;
+    qrconv_buf_free(&contents);
+    if (fclose(file) != 0 || !ok)
+    {
+        perror(path);
+        return -1;
+    }
+    return 1;
+}
+
+// same as chunkName() in website/src/convert/ti.ts
+static void chunk_name(char *name, const char *base, size_t chunk, uint32_t hash)
+{
+    if (chunk == 0)
+    {
+        snprintf(name, 9, "%s00", base);
+        return;
+    }
+    memcpy(name, base, 3);
+    for (int i = 3; i < 8; i++)
+    {
+        name[i] = 'A' + hash % 26;
+        hash /= 26;
+    }
+    name[8] = '\0';
+}
+
+// same as BookManifest in website/src/convert/ti.ts
+static int write_manifest(const char *dir, const char *base, const char *title, const qrconv_book_t *book)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s.json", dir, base);
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    fputs("{\"title\":", file);
+    qrconv_write_json_string(file, title);
+    fprintf(file, ",\"base\":\"%s\",\"appVars\":[", base);
+    for (size_t i = 0; i < book->chunk_count; i++)
+    {
+        char name[9];
+        chunk_name(name, base, i, book->chunk_hash[i]);
+        fprintf(file, "%s{\"name\":\"%s\",\"size\":%zu,\"hash\":%u}", i ? "," : "",
+                name, book->chunk_size[i], (unsigned int)book->chunk_hash[i]);
+    }
+    fputs("]}\n", file);
+    if (fclose(file) != 0)
+    {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+int qrconv_write_appvars(const char *dir, const char *base, const char *title,
+                         const qrconv_book_t *book, size_t *changed)
+{
+    if (book->chunk_count > 100)
+    {
+        fprintf(stderr, "qrconv: %s: book needs %zu appvars, at most 100 are supported\n", base, book->chunk_count);
+        return -1;
+    }
+    const uint8_t *data = book->data.data;
+    *changed = 0;
+    for (size_t i = 0; i < book->chunk_count; i++)
+    {
+        char name[9];
+        chunk_name(name, base, i, book->chunk_hash[i]);
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s.8xv", dir, name);
+        int written = write_appvar(path, name, data, book->chunk_size[i]);
+        if (written < 0)
+        {
+            return -1;
+        }
+        *changed += written;
+        data += book->chunk_size[i];
+    }
+    if (write_manifest(dir, base, title, book) != 0)
+    {
+        return -1;
+    }
+    return book->chunk_count;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "book.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Writes the chunks of a book as appvars in `dir`: `<base>00.8xv`, then one
+ * named after the hash of each other chunk (see src/quickrdr.h), and lists
+ * them in `<base>.json`. Files that already hold the same appvar are left
+ * alone; `changed` receives how many were written.
+ * @returns number of appvars in the book, or -1 on failure
+ */
+int qrconv_write_appvars(const char *dir, const char *base, const char *title,
+                         const qrconv_book_t *book, size_t *changed);
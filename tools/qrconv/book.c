@@ -0,0 +1,607 @@
+#define QUICKRDR_HOST
+#include "../../src/quickrdr.h"
+
+#include "book.h"
+#include "huffman.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    uint32_t codepoint;
+    size_t count;
+    const qrconv_bitmap_t *bitmap;
+    uint16_t id;
+} book_glyph_t;
+
+static size_t decode_utf8(const uint8_t *text, size_t size, uint32_t *out)
+{
+    size_t count = 0;
+    size_t i = 0;
+    while (i < size)
+    {
+        uint8_t byte = text[i];
+        uint32_t codepoint;
+        size_t extra;
+        if (byte < 0x80)
+        {
+            codepoint = byte;
+            extra = 0;
+        }
+        else if ((byte & 0xE0) == 0xC0)
+        {
+            codepoint = byte & 0x1F;
+            extra = 1;
+        }
+        else if ((byte & 0xF0) == 0xE0)
+        {
+            codepoint = byte & 0x0F;
+            extra = 2;
+        }
+        else if ((byte & 0xF8) == 0xF0)
+        {
+            codepoint = byte & 0x07;
+            extra = 3;
+        }
+        else
+        {
+            out[count++] = 0xFFFD;
+            i++;
+            continue;
+        }
+        if (i + extra >= size)
+        {
+            out[count++] = 0xFFFD;
+            break;
+        }
+        size_t j;
+        for (j = 1; j <= extra; j++)
+        {
+            if ((text[i + j] & 0xC0) != 0x80)
+            {
+                break;
+            }
+            codepoint = (codepoint << 6) | (text[i + j] & 0x3F);
+        }
+        if (j <= extra)
+        {
+            out[count++] = 0xFFFD;
+            i += j;
+            continue;
+        }
+        if (count == 0 && codepoint == 0xFEFF)
+        {
+            // byte order mark
+            i += extra + 1;
+            continue;
+        }
+        out[count++] = codepoint;
+        i += extra + 1;
+    }
+    return count;
+}
+
+// same scheme as calcMinExtensionByte() in website/src/convert/convert.ts
+static uint8_t calc_min_extension_byte(size_t total)
+{
+    if (total <= 255)
+    {
+        return 0;
+    }
+    // (m-1)+(256-m)*256 >= total
+    return (65535 - total) / 255;
+}
+
+static uint16_t get_glyph_id(size_t index, uint8_t min_extension_byte)
+{
+    if (index + 1 < min_extension_byte || min_extension_byte == 0)
+    {
+        return index + 1;
+    }
+    size_t extension = (index + 1 - min_extension_byte) >> 8;
+    size_t offset = (index + 1 - min_extension_byte) & 0xFF;
+    return ((min_extension_byte + extension) << 8) | offset;
+}
+
+static int compare_glyphs(const void *a, const void *b)
+{
+    const book_glyph_t *ga = a;
+    const book_glyph_t *gb = b;
+    if (ga->count != gb->count)
+    {
+        return ga->count < gb->count ? 1 : -1;
+    }
+    return ga->codepoint < gb->codepoint ? -1 : ga->codepoint > gb->codepoint;
+}
+
+// blocks are only cut by content once they are this long
+#define BLOCK_MIN_SIZE 256
+// top 9 bits of the gear hash, about 512 bytes between content cuts
+#define BLOCK_CUT_MASK 0xFF800000U
+// a block whose hash has this many low zero bits ends a stream chunk once it
+// holds CHUNK_MIN_SIZE bytes, same as CHUNK_CUT_LEVELS and CHUNK_MIN_SIZE in
+// website/src/convert/structs.ts
+static const int chunk_cut_levels[] = {3, -1};
+#define CHUNK_MIN_SIZE (48 * 1024)
+
+// gear hash of one byte, same as gear() in website/src/convert/stream.ts
+static uint32_t gear(uint8_t byte)
+{
+    return (byte + 1U) * 0x9E3779B1U;
+}
+
+typedef struct
+{
+    qrconv_buf_t data;
+    size_t *offsets;
+    size_t count;
+    size_t start; // of the current block
+    uint32_t hash;
+} block_stream_t;
+
+static void end_block(block_stream_t *stream)
+{
+    stream->start = stream->data.size;
+    stream->hash = 0;
+}
+
+static void push_byte(block_stream_t *stream, uint8_t byte)
+{
+    if (stream->start == stream->data.size)
+    {
+        stream->offsets = qrconv_xrealloc(stream->offsets, (stream->count + 1) * sizeof(size_t));
+        stream->offsets[stream->count++] = stream->start;
+    }
+    qrconv_buf_push(&stream->data, byte);
+    stream->hash = (stream->hash << 1) + gear(byte);
+}
+
+// same as StreamEncoder.push() in website/src/convert/stream.ts
+static void push_glyph_id(block_stream_t *stream, uint16_t id)
+{
+    size_t size = id > 0xFF ? 2 : 1;
+    if (stream->data.size + size - stream->start > QUICKRDR_BLOCK_SIZE)
+    {
+        end_block(stream);
+    }
+    if (id > 0xFF)
+    {
+        push_byte(stream, id >> 8);
+    }
+    push_byte(stream, id & 0xFF);
+    if (stream->data.size - stream->start >= BLOCK_MIN_SIZE && (stream->hash & BLOCK_CUT_MASK) == 0)
+    {
+        end_block(stream);
+    }
+}
+
+// decodes the glyph IDs of a block, 1 or 2 bytes each
+static size_t block_ids(const uint8_t *block, size_t size, uint8_t min_extension_byte, uint16_t *ids)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        uint16_t id = block[i];
+        if (min_extension_byte != 0 && id >= min_extension_byte)
+        {
+            id = (id << 8) | block[++i];
+        }
+        ids[count++] = id;
+    }
+    return count;
+}
+
+// replaces the blocks of `stream` by their Huffman codes, same as codeBlocks()
+// in website/src/convert/huffman.ts
+static void code_stream(block_stream_t *stream, uint8_t min_extension_byte, qrconv_code_t *code)
+{
+    size_t *counts = calloc(65536, sizeof(size_t));
+    uint16_t ids[QUICKRDR_BLOCK_SIZE];
+    for (size_t i = 0; i < stream->count; i++)
+    {
+        size_t end = i + 1 < stream->count ? stream->offsets[i + 1] : stream->data.size;
+        size_t count = block_ids(stream->data.data + stream->offsets[i], end - stream->offsets[i], min_extension_byte, ids);
+        for (size_t j = 0; j < count; j++)
+        {
+            counts[ids[j]]++;
+        }
+    }
+    qrconv_code_build(code, counts);
+    free(counts);
+    qrconv_buf_t coded = {0};
+    for (size_t i = 0; i < stream->count; i++)
+    {
+        size_t end = i + 1 < stream->count ? stream->offsets[i + 1] : stream->data.size;
+        size_t count = block_ids(stream->data.data + stream->offsets[i], end - stream->offsets[i], min_extension_byte, ids);
+        stream->offsets[i] = coded.size;
+        qrconv_code_block(code, ids, count, &coded);
+    }
+    qrconv_buf_free(&stream->data);
+    stream->data = coded;
+}
+
+typedef struct
+{
+    size_t chunk_count;
+    size_t chunk_size[QRCONV_MAX_CHUNKS];
+    uint32_t page_table;
+    uint32_t symbol_table;
+    uint32_t glyph_table;
+} book_layout_t;
+
+// starts a new chunk unless the last one is empty
+static int new_chunk(book_layout_t *layout)
+{
+    if (layout->chunk_size[layout->chunk_count - 1] == 0)
+    {
+        return 0;
+    }
+    if (layout->chunk_count >= QRCONV_MAX_CHUNKS)
+    {
+        return -1;
+    }
+    layout->chunk_size[layout->chunk_count++] = 0;
+    return 0;
+}
+
+// appends a record to the last chunk, or starts a new one if it does not fit
+static int place_record(book_layout_t *layout, size_t size, uint32_t *address)
+{
+    if (size > QUICKRDR_CHUNK_SIZE)
+    {
+        return -1;
+    }
+    if (layout->chunk_size[layout->chunk_count - 1] + size > QUICKRDR_CHUNK_SIZE && new_chunk(layout) != 0)
+    {
+        return -1;
+    }
+    size_t chunk = layout->chunk_count - 1;
+    *address = QUICKRDR_ADDRESS((uint32_t)chunk, (uint32_t)layout->chunk_size[chunk]);
+    layout->chunk_size[chunk] += size;
+    return 0;
+}
+
+uint32_t qrconv_table_record(uint32_t table, size_t record_size, size_t index)
+{
+    size_t first_count = (QUICKRDR_CHUNK_SIZE - (table & 0xFFFF)) / record_size;
+    if (index < first_count)
+    {
+        return table + index * record_size;
+    }
+    index -= first_count;
+    size_t per_chunk = QUICKRDR_CHUNK_SIZE / record_size;
+    return QUICKRDR_ADDRESS((table >> 16) + 1 + index / per_chunk, (index % per_chunk) * record_size);
+}
+
+/**
+ * Places the tables and stream blocks of a version 4 or later book whose
+ * header lists `chunk_count` chunks. The caller repeats this until
+ * layout->chunk_count matches, since the header size depends on it. The
+ * symbol table of a version 6 book (`symbol_count` > 0) follows the page
+ * table. Once a stream chunk holds CHUNK_MIN_SIZE bytes, it ends after the
+ * next block whose hash has `level` low zero bits, never if -1.
+ * @returns 0 on success, -1 if the book needs too many chunks
+ */
+static int layout_chunks(book_layout_t *layout, size_t chunk_count,
+                         size_t page_count, const size_t *page_offsets, const uint32_t *page_hashes, size_t pages_size,
+                         size_t symbol_count, size_t glyph_count, size_t glyph_size, int level, size_t *page_addresses)
+{
+    layout->chunk_count = 1;
+    layout->chunk_size[0] = sizeof(quickrdr_header_t) + sizeof(quickrdr_layout_t) +
+                            chunk_count * (sizeof(uint16_t) + sizeof(uint32_t)) +
+                            (symbol_count ? sizeof(quickrdr_code_t) : 0);
+    uint32_t address;
+    layout->page_table = 0;
+    for (size_t i = 0; i < page_count; i++)
+    {
+        if (place_record(layout, sizeof(uint24_t), &address) != 0)
+        {
+            return -1;
+        }
+        if (i == 0)
+        {
+            layout->page_table = address;
+        }
+    }
+    layout->symbol_table = 0;
+    for (size_t i = 0; i < symbol_count; i++)
+    {
+        if (place_record(layout, sizeof(uint16_t), &address) != 0)
+        {
+            return -1;
+        }
+        if (i == 0)
+        {
+            layout->symbol_table = address;
+        }
+    }
+    layout->glyph_table = 0;
+    if (new_chunk(layout) != 0)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < glyph_count; i++)
+    {
+        if (place_record(layout, glyph_size, &address) != 0)
+        {
+            return -1;
+        }
+        if (i == 0)
+        {
+            layout->glyph_table = address;
+        }
+    }
+    if (new_chunk(layout) != 0)
+    {
+        return -1;
+    }
+    uint32_t mask = level >= 0 ? (1U << level) - 1 : 0;
+    for (size_t i = 0; i < page_count; i++)
+    {
+        size_t size = (i + 1 < page_count ? page_offsets[i + 1] : pages_size) - page_offsets[i];
+        if (place_record(layout, size, &address) != 0)
+        {
+            return -1;
+        }
+        page_addresses[i] = address;
+        int filled = layout->chunk_size[layout->chunk_count - 1] >= CHUNK_MIN_SIZE;
+        if (level >= 0 && i + 1 < page_count && filled && (page_hashes[i] & mask) == 0 && new_chunk(layout) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int qrconv_build_book(qrconv_font_t *font, const qrconv_book_options_t *options,
+                      const uint8_t *text, size_t text_size,
+                      qrconv_book_t *out, qrconv_book_stats_t *stats)
+{
+    int result = -1;
+    qrconv_code_t *code = NULL;
+    uint32_t *codepoints = qrconv_xmalloc(text_size * sizeof(uint32_t));
+    size_t length = decode_utf8(text, text_size, codepoints);
+
+    // glyph discovery
+    qrconv_map_t index = {0};
+    book_glyph_t *glyphs = NULL;
+    size_t glyph_count = 0;
+    size_t missing_count = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        uint32_t codepoint = codepoints[i];
+        if (codepoint == '\n' || codepoint == '\r')
+        {
+            continue;
+        }
+        size_t *slot = qrconv_map_get(&index, codepoint, SIZE_MAX);
+        if (*slot == SIZE_MAX)
+        {
+            glyphs = qrconv_xrealloc(glyphs, (glyph_count + 1) * sizeof(book_glyph_t));
+            glyphs[glyph_count].codepoint = codepoint;
+            glyphs[glyph_count].count = 0;
+            glyphs[glyph_count].bitmap = qrconv_font_glyph(font, codepoint);
+            *slot = glyph_count++;
+        }
+        glyphs[*slot].count++;
+    }
+
+    // drop glyphs missing from the font, most frequent glyphs get 1-byte IDs
+    size_t kept = 0;
+    for (size_t i = 0; i < glyph_count; i++)
+    {
+        if (glyphs[i].bitmap != NULL)
+        {
+            glyphs[kept++] = glyphs[i];
+        }
+        else
+        {
+            missing_count += glyphs[i].count;
+        }
+    }
+    glyph_count = kept;
+    if (glyph_count == 0)
+    {
+        fprintf(stderr, "qrconv: %s: no printable characters\n", options->title);
+        goto out;
+    }
+    if (glyph_count > 65535 - 255)
+    {
+        fprintf(stderr, "qrconv: %s: too many distinct characters (%zu)\n", options->title, glyph_count);
+        goto out;
+    }
+    qsort(glyphs, glyph_count, sizeof(book_glyph_t), compare_glyphs);
+    uint8_t min_extension_byte = calc_min_extension_byte(glyph_count);
+    uint8_t max_height = 0;
+    size_t max_data_size = 0;
+    qrconv_map_free(&index);
+    for (size_t i = 0; i < glyph_count; i++)
+    {
+        glyphs[i].id = get_glyph_id(i, min_extension_byte);
+        *qrconv_map_get(&index, glyphs[i].codepoint, 0) = i;
+        if (glyphs[i].bitmap->height > max_height)
+        {
+            max_height = glyphs[i].bitmap->height;
+        }
+        if (glyphs[i].bitmap->data_size > max_data_size)
+        {
+            max_data_size = glyphs[i].bitmap->data_size;
+        }
+    }
+    // glyph stream, same as StreamEncoder in website/src/convert/stream.ts
+    block_stream_t stream = {0};
+    for (size_t i = 0; i < length; i++)
+    {
+        uint32_t codepoint = codepoints[i];
+        uint16_t id;
+        if (codepoint == '\n')
+        {
+            id = 0;
+        }
+        else
+        {
+            size_t *slot = qrconv_map_find(&index, codepoint);
+            if (slot == NULL)
+            {
+                // '\r' and characters without a glyph
+                continue;
+            }
+            id = glyphs[*slot].id;
+        }
+        push_glyph_id(&stream, id);
+    }
+    if (options->coded)
+    {
+        if (stream.count > QUICKRDR_MAX_CODED_BLOCKS)
+        {
+            fprintf(stderr, "qrconv: %s: too long to code the stream (%zu blocks)\n", options->title, stream.count);
+            qrconv_buf_free(&stream.data);
+            free(stream.offsets);
+            goto out;
+        }
+        code = qrconv_xmalloc(sizeof(qrconv_code_t));
+        code_stream(&stream, min_extension_byte, code);
+    }
+    size_t symbol_count = code != NULL ? code->symbol_count : 0;
+    size_t block_count = stream.count;
+    size_t *block_offsets = stream.offsets;
+    uint32_t *block_hashes = qrconv_xmalloc((block_count + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < block_count; i++)
+    {
+        size_t size = (i + 1 < block_count ? block_offsets[i + 1] : stream.data.size) - block_offsets[i];
+        block_hashes[i] = qrconv_fnv1a(stream.data.data + block_offsets[i], size);
+    }
+
+    // layout, same as QuickRDRFile.asChunks() in website/src/convert/structs.ts
+    size_t font_glyph_size = max_data_size + sizeof(quickrdr_glyph_t);
+    size_t *block_addresses = qrconv_xmalloc((block_count + 1) * sizeof(size_t));
+    book_layout_t layout;
+    size_t chunk_count;
+    int laid_out = -1;
+    for (size_t l = 0; l < sizeof(chunk_cut_levels) / sizeof(chunk_cut_levels[0]) && laid_out != 0; l++)
+    {
+        layout.chunk_count = 1;
+        do
+        {
+            chunk_count = layout.chunk_count;
+            laid_out = layout_chunks(&layout, chunk_count, block_count, block_offsets, block_hashes, stream.data.size,
+                                     symbol_count, glyph_count, font_glyph_size, chunk_cut_levels[l], block_addresses);
+        } while (laid_out == 0 && layout.chunk_count != chunk_count);
+    }
+    if (laid_out != 0)
+    {
+        fprintf(stderr, "qrconv: %s: book needs more than %d appvars\n", options->title, QRCONV_MAX_CHUNKS);
+        qrconv_buf_free(&stream.data);
+        free(block_offsets);
+        free(block_hashes);
+        free(block_addresses);
+        goto out;
+    }
+
+    size_t chunk_base[QRCONV_MAX_CHUNKS];
+    size_t total_size = 0;
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        chunk_base[i] = total_size;
+        total_size += layout.chunk_size[i];
+    }
+#define AT(address) (out->data.data + chunk_base[(address) >> 16] + ((address) & 0xFFFF))
+    out->data.size = 0;
+    qrconv_buf_reserve(&out->data, total_size);
+    memset(out->data.data, 0, total_size);
+    out->data.size = total_size;
+    out->chunk_count = chunk_count;
+    memcpy(out->chunk_size, layout.chunk_size, chunk_count * sizeof(size_t));
+
+    quickrdr_header_t *header = (quickrdr_header_t *)out->data.data;
+    memcpy(header->magic, "QRDR", sizeof(header->magic));
+    header->version = code != NULL ? 6 : qrconv_font_bpp(font) == 2 ? 5 : 4;
+    strncpy(header->name, options->title, sizeof(header->name) - 1);
+    qrconv_put24(header->total_size.bytes, total_size);
+    header->min_extension_byte = min_extension_byte;
+    header->line_height = max_height;
+    qrconv_put24(header->font_glyph_count.bytes, glyph_count);
+    header->font_glyph_size = font_glyph_size;
+    qrconv_put24(header->page_count.bytes, block_count);
+
+    quickrdr_layout_t *chunks = (quickrdr_layout_t *)(header + 1);
+    chunks->chunk_count = chunk_count;
+    qrconv_put24(chunks->page_table.bytes, layout.page_table);
+    qrconv_put24(chunks->glyph_table.bytes, layout.glyph_table);
+    uint8_t *ptr = (uint8_t *)(chunks + 1);
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        qrconv_put16(ptr + i * sizeof(uint16_t), layout.chunk_size[i]);
+    }
+
+    for (size_t i = 0; i < block_count; i++)
+    {
+        uint32_t address = qrconv_table_record(layout.page_table, sizeof(uint24_t), i);
+        qrconv_put24(AT(address), block_addresses[i]);
+        size_t size = (i + 1 < block_count ? block_offsets[i + 1] : stream.data.size) - block_offsets[i];
+        memcpy(AT(block_addresses[i]), stream.data.data + block_offsets[i], size);
+    }
+    for (size_t i = 0; i < glyph_count; i++)
+    {
+        const qrconv_bitmap_t *bitmap = glyphs[i].bitmap;
+        ptr = AT(qrconv_table_record(layout.glyph_table, font_glyph_size, i));
+        qrconv_put16(ptr + offsetof(quickrdr_glyph_t, glyph_id), glyphs[i].id);
+        ptr[offsetof(quickrdr_glyph_t, width)] = bitmap->width;
+        ptr[offsetof(quickrdr_glyph_t, height)] = bitmap->height;
+        memcpy(ptr + sizeof(quickrdr_glyph_t), bitmap->data, bitmap->data_size);
+    }
+    if (code != NULL)
+    {
+        quickrdr_code_t *coding = (quickrdr_code_t *)((uint8_t *)(chunks + 1) +
+                                                      chunk_count * (sizeof(uint16_t) + sizeof(uint32_t)));
+        coding->glyph_bpp = qrconv_font_bpp(font);
+        qrconv_put24(coding->symbol_table.bytes, layout.symbol_table);
+        for (size_t i = 0; i < QUICKRDR_MAX_CODE_LENGTH; i++)
+        {
+            qrconv_put16((uint8_t *)&coding->length_count[i], code->length_count[i]);
+        }
+        for (size_t i = 0; i < symbol_count; i++)
+        {
+            qrconv_put16(AT(qrconv_table_record(layout.symbol_table, sizeof(uint16_t), i)), code->symbols[i]);
+        }
+    }
+    // the calculator finds the other appvars by these hashes
+    ptr = (uint8_t *)(chunks + 1) + chunk_count * sizeof(uint16_t);
+    out->chunk_hash[0] = 0;
+    for (size_t i = 1; i < chunk_count; i++)
+    {
+        out->chunk_hash[i] = qrconv_fnv1a(out->data.data + chunk_base[i], layout.chunk_size[i]);
+        qrconv_put32(ptr + i * sizeof(uint32_t), out->chunk_hash[i]);
+    }
+#undef AT
+    qrconv_buf_free(&stream.data);
+    free(block_offsets);
+    free(block_hashes);
+    free(block_addresses);
+
+    if (stats != NULL)
+    {
+        stats->glyph_count = glyph_count;
+        stats->block_count = block_count;
+        stats->missing_count = missing_count;
+        stats->glyph_padding = 0;
+        for (size_t i = 0; i < glyph_count; i++)
+        {
+            stats->glyph_padding += max_data_size - glyphs[i].bitmap->data_size;
+        }
+    }
+    result = 0;
+
+out:
+    if (code != NULL)
+    {
+        qrconv_code_free(code);
+        free(code);
+    }
+    qrconv_map_free(&index);
+    free(glyphs);
+    free(codepoints);
+    return result;
+}
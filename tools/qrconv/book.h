@@ -0,0 +1,45 @@
+#pragma once
+
+#include "font.h"
+#include "util.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    const char *title;
+    int coded; // Huffman-code the glyph stream (version 6)
+} qrconv_book_options_t;
+
+#define QRCONV_MAX_CHUNKS 100
+
+typedef struct
+{
+    qrconv_buf_t data; // contents of the appvars, back to back
+    size_t chunk_count;
+    size_t chunk_size[QRCONV_MAX_CHUNKS];
+    uint32_t chunk_hash[QRCONV_MAX_CHUNKS]; // names the appvars, 0 for the first
+} qrconv_book_t;
+
+typedef struct
+{
+    size_t glyph_count;
+    size_t block_count; // of the glyph stream
+    size_t missing_count; // characters dropped because the font has no glyph
+    size_t glyph_padding; // bytes added to pad every glyph to font_glyph_size
+} qrconv_book_stats_t;
+
+/**
+ * Converts UTF-8 text into a version 4 QuickRDR book, version 5 with a 2bpp
+ * font or version 6 with a coded stream (see src/quickrdr.h).
+ * @returns 0 on success, -1 on failure
+ */
+int qrconv_build_book(qrconv_font_t *font, const qrconv_book_options_t *options,
+                      const uint8_t *text, size_t text_size,
+                      qrconv_book_t *out, qrconv_book_stats_t *stats);
+
+/**
+ * @returns address of a table record, mirrors table_record() in src/quickrdr.c
+ */
+uint32_t qrconv_table_record(uint32_t table, size_t record_size, size_t index);
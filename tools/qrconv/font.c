@@ -0,0 +1,154 @@
+#include "font.h"
+#include "util.h"
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct qrconv_font
+{
+    FT_Library library;
+    FT_Face face;
+    int ascent; // pixels from the top of a glyph cell to the baseline
+    unsigned int bpp;
+    // rasterized glyphs are kept for the lifetime of the font, so a thread
+    // converting several books in the same font only renders each glyph once
+    qrconv_map_t cache;
+    qrconv_bitmap_t **bitmaps; // NULL entries are glyphs missing from the font
+    size_t bitmap_count;
+};
+
+qrconv_font_t *qrconv_font_open(const uint8_t *file, size_t size, unsigned int pixel_size, unsigned int bpp)
+{
+    qrconv_font_t *font = calloc(1, sizeof(qrconv_font_t));
+    if (font == NULL)
+    {
+        return NULL;
+    }
+    if (FT_Init_FreeType(&font->library))
+    {
+        fprintf(stderr, "qrconv: failed to initialize FreeType\n");
+        free(font);
+        return NULL;
+    }
+    if (FT_New_Memory_Face(font->library, file, size, 0, &font->face))
+    {
+        fprintf(stderr, "qrconv: failed to load font face\n");
+        FT_Done_FreeType(font->library);
+        free(font);
+        return NULL;
+    }
+    if (FT_Set_Pixel_Sizes(font->face, 0, pixel_size))
+    {
+        fprintf(stderr, "qrconv: font does not support size %u\n", pixel_size);
+        qrconv_font_close(font);
+        return NULL;
+    }
+    font->ascent = (font->face->size->metrics.ascender + 63) >> 6;
+    font->bpp = bpp;
+    return font;
+}
+
+unsigned int qrconv_font_bpp(const qrconv_font_t *font)
+{
+    return font->bpp;
+}
+
+void qrconv_font_close(qrconv_font_t *font)
+{
+    if (font == NULL)
+    {
+        return;
+    }
+    for (size_t i = 0; i < font->bitmap_count; i++)
+    {
+        if (font->bitmaps[i] != NULL)
+        {
+            free(font->bitmaps[i]->data);
+            free(font->bitmaps[i]);
+        }
+    }
+    free(font->bitmaps);
+    qrconv_map_free(&font->cache);
+    FT_Done_Face(font->face);
+    FT_Done_FreeType(font->library);
+    free(font);
+}
+
+static qrconv_bitmap_t *rasterize(qrconv_font_t *font, uint32_t codepoint)
+{
+    FT_UInt index = FT_Get_Char_Index(font->face, codepoint);
+    if (index == 0)
+    {
+        return NULL;
+    }
+    if (FT_Load_Glyph(font->face, index, FT_LOAD_RENDER | (font->bpp == 2 ? FT_LOAD_TARGET_NORMAL : FT_LOAD_TARGET_MONO)))
+    {
+        return NULL;
+    }
+    FT_GlyphSlot slot = font->face->glyph;
+    FT_Bitmap *bm = &slot->bitmap;
+    int left = slot->bitmap_left > 0 ? slot->bitmap_left : 0;
+    int advance = (slot->advance.x + 63) >> 6;
+    int width = left + (int)bm->width > advance ? left + (int)bm->width : advance;
+    int descent = (int)bm->rows - slot->bitmap_top;
+    int height = font->ascent + (descent > 0 ? descent : 0);
+    if (width > 255 || height > 255)
+    {
+        fprintf(stderr, "qrconv: glyph U+%04X is too large (%dx%d)\n", codepoint, width, height);
+        return NULL;
+    }
+    qrconv_bitmap_t *bitmap = qrconv_xmalloc(sizeof(qrconv_bitmap_t));
+    bitmap->width = width;
+    bitmap->height = height;
+    size_t row_bytes = (width + 3) / 4;
+    bitmap->data_size = font->bpp == 2 ? row_bytes * height : (size_t)(width * height + 7) / 8;
+    bitmap->data = calloc(bitmap->data_size ? bitmap->data_size : 1, 1);
+    for (unsigned int row = 0; row < bm->rows; row++)
+    {
+        int y = font->ascent - slot->bitmap_top + (int)row;
+        if (y < 0 || y >= height)
+        {
+            continue;
+        }
+        const uint8_t *src = bm->buffer + row * bm->pitch;
+        for (unsigned int col = 0; col < bm->width; col++)
+        {
+            int x = left + col;
+            if (x >= width)
+            {
+                continue;
+            }
+            if (font->bpp == 2)
+            {
+                // 256 gray levels down to 4, 3 is ink
+                unsigned int level = (src[col] * 3 + 127) / 255;
+                bitmap->data[y * row_bytes + x / 4] |= level << (6 - 2 * (x % 4));
+                continue;
+            }
+            if (!(src[col / 8] & (0x80 >> (col % 8))))
+            {
+                continue;
+            }
+            unsigned int bit = y * width + x;
+            bitmap->data[bit / 8] |= 0x80 >> (bit % 8);
+        }
+    }
+    return bitmap;
+}
+
+const qrconv_bitmap_t *qrconv_font_glyph(qrconv_font_t *font, uint32_t codepoint)
+{
+    size_t *slot = qrconv_map_get(&font->cache, codepoint, SIZE_MAX);
+    if (*slot != SIZE_MAX)
+    {
+        return font->bitmaps[*slot];
+    }
+    *slot = font->bitmap_count;
+    font->bitmaps = qrconv_xrealloc(font->bitmaps, (font->bitmap_count + 1) * sizeof(qrconv_bitmap_t *));
+    font->bitmaps[font->bitmap_count] = rasterize(font, codepoint);
+    return font->bitmaps[font->bitmap_count++];
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint8_t width;
+    uint8_t height;
+    size_t data_size;
+    uint8_t *data; // 1 bit per pixel, MSB first, rows not padded; or 2 bits per
+                   // pixel, rows padded to a byte (see version 5 in src/quickrdr.h)
+} qrconv_bitmap_t;
+
+typedef struct qrconv_font qrconv_font_t;
+
+/**
+ * Opens a font from memory. Each thread must open its own instance; `file`
+ * must outlive the returned font and may be shared between instances. Glyphs
+ * are rasterized with `bpp` bits per pixel: 1 is thresholded, 2 anti-aliased.
+ */
+qrconv_font_t *qrconv_font_open(const uint8_t *file, size_t size, unsigned int pixel_size, unsigned int bpp);
+void qrconv_font_close(qrconv_font_t *font);
+unsigned int qrconv_font_bpp(const qrconv_font_t *font);
+/**
+ * @returns the rasterized glyph, or NULL if the font has no glyph for it
+ */
+const qrconv_bitmap_t *qrconv_font_glyph(qrconv_font_t *font, uint32_t codepoint);
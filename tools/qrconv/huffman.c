@@ -0,0 +1,238 @@
+#include "huffman.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// deepest leaf of a Huffman tree over at most ~2^32 occurrences
+#define MAX_TREE_DEPTH 64
+
+typedef struct
+{
+    size_t weight;
+    uint16_t id;
+    uint8_t length;
+} leaf_t;
+
+static int compare_rarest(const void *a, const void *b)
+{
+    const leaf_t *la = a;
+    const leaf_t *lb = b;
+    if (la->weight != lb->weight)
+    {
+        return la->weight < lb->weight ? -1 : 1;
+    }
+    return la->id < lb->id ? -1 : la->id > lb->id;
+}
+
+static int compare_commonest(const void *a, const void *b)
+{
+    const leaf_t *la = a;
+    const leaf_t *lb = b;
+    if (la->weight != lb->weight)
+    {
+        return la->weight > lb->weight ? -1 : 1;
+    }
+    return la->id < lb->id ? -1 : la->id > lb->id;
+}
+
+static int compare_canonical(const void *a, const void *b)
+{
+    const leaf_t *la = a;
+    const leaf_t *lb = b;
+    if (la->length != lb->length)
+    {
+        return la->length < lb->length ? -1 : 1;
+    }
+    return la->id < lb->id ? -1 : la->id > lb->id;
+}
+
+// codes per length of a Huffman tree, built with two queues: the leaves from
+// rarest to commonest and the inner nodes in the order they are made, a leaf
+// going first on equal weights
+static void tree_lengths(leaf_t *leaves, size_t count, size_t *bits)
+{
+    if (count == 1)
+    {
+        bits[1] = 1;
+        return;
+    }
+    size_t nodes = 2 * count - 1;
+    size_t *weight = qrconv_xmalloc(nodes * sizeof(size_t));
+    size_t *parent = qrconv_xmalloc(nodes * sizeof(size_t));
+    size_t *depth = qrconv_xmalloc(nodes * sizeof(size_t));
+    for (size_t i = 0; i < count; i++)
+    {
+        weight[i] = leaves[i].weight;
+    }
+    size_t next_leaf = 0;
+    size_t next_inner = count;
+    for (size_t made = count; made < nodes; made++)
+    {
+        weight[made] = 0;
+        for (int pick = 0; pick < 2; pick++)
+        {
+            size_t node;
+            if (next_leaf < count && (next_inner == made || weight[next_leaf] <= weight[next_inner]))
+            {
+                node = next_leaf++;
+            }
+            else
+            {
+                node = next_inner++;
+            }
+            parent[node] = made;
+            weight[made] += weight[node];
+        }
+    }
+    depth[nodes - 1] = 0;
+    for (size_t i = nodes - 1; i-- > 0;)
+    {
+        depth[i] = depth[parent[i]] + 1;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        bits[depth[i] < MAX_TREE_DEPTH ? depth[i] : MAX_TREE_DEPTH - 1]++;
+    }
+    free(weight);
+    free(parent);
+    free(depth);
+}
+
+void qrconv_code_build(qrconv_code_t *code, const size_t *counts)
+{
+    memset(code->length_count, 0, sizeof(code->length_count));
+    memset(code->length, 0, sizeof(code->length));
+    memset(code->code, 0, sizeof(code->code));
+    leaf_t *leaves = qrconv_xmalloc(65536 * sizeof(leaf_t));
+    size_t count = 0;
+    for (size_t id = 0; id < 65536; id++)
+    {
+        if (counts[id])
+        {
+            leaves[count].weight = counts[id];
+            leaves[count].id = id;
+            count++;
+        }
+    }
+    code->symbol_count = count;
+    code->symbols = qrconv_xmalloc((count + 1) * sizeof(uint16_t));
+    if (count == 0)
+    {
+        free(leaves);
+        return;
+    }
+    qsort(leaves, count, sizeof(leaf_t), compare_rarest);
+    size_t bits[MAX_TREE_DEPTH] = {0};
+    tree_lengths(leaves, count, bits);
+    // limit the codes to QUICKRDR_MAX_CODE_LENGTH bits, like JPEG (ITU T.81 K.3)
+    for (size_t i = MAX_TREE_DEPTH - 1; i > QUICKRDR_MAX_CODE_LENGTH; i--)
+    {
+        while (bits[i] > 0)
+        {
+            size_t j = i - 2;
+            while (bits[j] == 0)
+            {
+                j--;
+            }
+            bits[i] -= 2;
+            bits[i - 1]++;
+            bits[j + 1] += 2;
+            bits[j]--;
+        }
+    }
+    // the shortest codes go to the commonest glyphs
+    qsort(leaves, count, sizeof(leaf_t), compare_commonest);
+    size_t next = 0;
+    for (uint8_t length = 1; length <= QUICKRDR_MAX_CODE_LENGTH; length++)
+    {
+        code->length_count[length - 1] = bits[length];
+        for (size_t i = 0; i < bits[length]; i++)
+        {
+            leaves[next++].length = length;
+        }
+    }
+    qsort(leaves, count, sizeof(leaf_t), compare_canonical);
+    uint32_t value = 0;
+    uint8_t length = leaves[0].length;
+    for (size_t i = 0; i < count; i++)
+    {
+        value <<= leaves[i].length - length;
+        length = leaves[i].length;
+        code->symbols[i] = leaves[i].id;
+        code->length[leaves[i].id] = length;
+        code->code[leaves[i].id] = value++;
+    }
+    free(leaves);
+}
+
+void qrconv_code_free(qrconv_code_t *code)
+{
+    free(code->symbols);
+    code->symbols = NULL;
+}
+
+void qrconv_code_block(const qrconv_code_t *code, const uint16_t *ids, size_t count, qrconv_buf_t *out)
+{
+    qrconv_buf_push(out, count & 0xFF);
+    qrconv_buf_push(out, count >> 8);
+    uint32_t pending = 0; // bits not written yet, in the low `used` bits
+    int used = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        pending = (pending << code->length[ids[i]]) | code->code[ids[i]];
+        used += code->length[ids[i]];
+        while (used >= 8)
+        {
+            used -= 8;
+            qrconv_buf_push(out, (pending >> used) & 0xFF);
+        }
+    }
+    if (used > 0)
+    {
+        qrconv_buf_push(out, (pending << (8 - used)) & 0xFF);
+    }
+}
+
+size_t qrconv_decode_block(const uint16_t *length_count, const uint16_t *symbols,
+                           const uint8_t *block, size_t size, uint16_t *ids)
+{
+    if (size < 2)
+    {
+        return (size_t)-1;
+    }
+    size_t count = qrconv_get16(block);
+    if (count > QUICKRDR_BLOCK_SIZE)
+    {
+        return (size_t)-1;
+    }
+    size_t bit = 16;
+    for (size_t i = 0; i < count; i++)
+    {
+        // canonical codes of each length follow the last code of the one before
+        uint32_t value = 0;
+        uint32_t first = 0;
+        size_t symbol = 0;
+        uint8_t length;
+        for (length = 1; length <= QUICKRDR_MAX_CODE_LENGTH; length++)
+        {
+            if (bit >= 8 * size)
+            {
+                return (size_t)-1;
+            }
+            value = (value << 1) | ((block[bit / 8] >> (7 - bit % 8)) & 1);
+            bit++;
+            if (value - first < length_count[length - 1])
+            {
+                ids[i] = symbols[symbol + value - first];
+                break;
+            }
+            symbol += length_count[length - 1];
+            first = (first + length_count[length - 1]) << 1;
+        }
+        if (length > QUICKRDR_MAX_CODE_LENGTH)
+        {
+            return (size_t)-1;
+        }
+    }
+    return count;
+}
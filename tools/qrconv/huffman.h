@@ -0,0 +1,39 @@
+#pragma once
+
+#define QUICKRDR_HOST
+#include "../../src/quickrdr.h"
+
+#include "util.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// canonical Huffman code over glyph IDs, see quickrdr_code_t in src/quickrdr.h
+typedef struct
+{
+    size_t symbol_count;
+    uint16_t *symbols; // glyph IDs in the order of their codes
+    uint16_t length_count[QUICKRDR_MAX_CODE_LENGTH];
+    uint8_t length[65536]; // by glyph ID, 0 for IDs not in the stream
+    uint16_t code[65536];
+} qrconv_code_t;
+
+/**
+ * Builds the code for glyph IDs that occur `counts[id]` times, the same code
+ * as buildCode() in website/src/convert/huffman.ts.
+ */
+void qrconv_code_build(qrconv_code_t *code, const size_t *counts);
+void qrconv_code_free(qrconv_code_t *code);
+
+/**
+ * Appends a block of a version 6 stream: the number of glyph IDs and their codes.
+ */
+void qrconv_code_block(const qrconv_code_t *code, const uint16_t *ids, size_t count, qrconv_buf_t *out);
+
+/**
+ * Decodes a block of a version 6 stream into `ids`, which has room for
+ * QUICKRDR_BLOCK_SIZE glyph IDs. `symbols` are the glyph IDs in code order.
+ * @returns the number of glyph IDs, or (size_t)-1 for an invalid block
+ */
+size_t qrconv_decode_block(const uint16_t *length_count, const uint16_t *symbols,
+                           const uint8_t *block, size_t size, uint16_t *ids);
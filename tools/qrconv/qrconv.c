@@ -0,0 +1,291 @@
+// qrconv: native batch converter from UTF-8 text to QuickRDR appvars
+#include "appvar.h"
+#include "book.h"
+#include "font.h"
+#include "report.h"
+#include "util.h"
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct
+{
+    const char *path;
+    char title[16];
+    char base[7];
+    int status;
+} job_t;
+
+typedef struct
+{
+    const uint8_t *font_file;
+    size_t font_size;
+    unsigned int pixel_size;
+    unsigned int bpp; // 2 for anti-aliased glyphs
+    int coded;        // Huffman-code the glyph stream
+    const char *output_dir;
+    int report; // also write <BASE>.report.json
+    job_t *jobs;
+    size_t job_count;
+    atomic_size_t next_job;
+} context_t;
+
+static uint8_t *read_file(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        perror(path);
+        return NULL;
+    }
+    qrconv_buf_t buf = {0};
+    uint8_t chunk[65536];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    {
+        qrconv_buf_append(&buf, chunk, read);
+    }
+    if (ferror(file))
+    {
+        perror(path);
+        fclose(file);
+        qrconv_buf_free(&buf);
+        return NULL;
+    }
+    fclose(file);
+    *size = buf.size;
+    return buf.data ? buf.data : qrconv_xmalloc(1);
+}
+
+// title is the file name without directory and extension, limited to the header's 15 chars
+static void make_title(const char *path, char *title)
+{
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    const char *dot = strrchr(name, '.');
+    size_t length = dot && dot != name ? (size_t)(dot - name) : strlen(name);
+    size_t j = 0;
+    for (size_t i = 0; i < length && j < 15; i++)
+    {
+        unsigned char c = name[i];
+        if (c >= 0x80)
+        {
+            // skip UTF-8 continuation bytes, the OS font is ASCII only
+            if ((c & 0xC0) != 0x80)
+            {
+                title[j++] = '?';
+            }
+            continue;
+        }
+        title[j++] = c == '_' ? ' ' : c;
+    }
+    title[j] = '\0';
+}
+
+// appvar base names are derived from the title so batch runs are reproducible
+static void make_base_name(const char *title, unsigned int salt, char *base)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    uint32_t hash = 2166136261U ^ salt;
+    for (const char *c = title; *c; c++)
+    {
+        hash = (hash ^ (uint8_t)*c) * 16777619U;
+    }
+    base[0] = alphabet[hash % 26];
+    hash /= 26;
+    for (int i = 1; i < 6; i++)
+    {
+        hash = hash * 16777619U + i;
+        base[i] = alphabet[(hash >> 8) % 36];
+    }
+    base[6] = '\0';
+}
+
+static void convert_job(context_t *ctx, qrconv_font_t *font, job_t *job)
+{
+    size_t text_size;
+    uint8_t *text = read_file(job->path, &text_size);
+    if (text == NULL)
+    {
+        return;
+    }
+    qrconv_book_options_t options = {
+        .title = job->title,
+        .coded = ctx->coded,
+    };
+    qrconv_book_t book = {0};
+    qrconv_book_stats_t stats;
+    if (qrconv_build_book(font, &options, text, text_size, &book, &stats) == 0)
+    {
+        size_t changed;
+        int appvars = qrconv_write_appvars(ctx->output_dir, job->base, job->title, &book, &changed);
+        if (appvars > 0 && (!ctx->report || qrconv_write_report(ctx->output_dir, job->base, job->title, &book, &stats) == 0))
+        {
+            printf("%s -> %s (%zu blocks, %zu glyphs, %d appvars, %zu new or changed)\n",
+                   job->path, job->base, stats.block_count, stats.glyph_count, appvars, changed);
+            if (stats.missing_count)
+            {
+                fprintf(stderr, "qrconv: %s: dropped %zu characters missing from the font\n",
+                        job->path, stats.missing_count);
+            }
+            job->status = 0;
+        }
+    }
+    qrconv_buf_free(&book.data);
+    free(text);
+}
+
+static void *worker(void *arg)
+{
+    context_t *ctx = arg;
+    // FreeType handles may not be shared between threads
+    qrconv_font_t *font = qrconv_font_open(ctx->font_file, ctx->font_size, ctx->pixel_size, ctx->bpp);
+    if (font == NULL)
+    {
+        return NULL;
+    }
+    size_t index;
+    while ((index = atomic_fetch_add(&ctx->next_job, 1)) < ctx->job_count)
+    {
+        convert_job(ctx, font, &ctx->jobs[index]);
+    }
+    qrconv_font_close(font);
+    return NULL;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s -f FONT [-s SIZE] [-j JOBS] [-o DIR] [-g] [-z] [-r] FILE.txt...\n"
+            "  -f FONT     TrueType/OpenType font to rasterize with\n"
+            "  -s SIZE     font size in pixels (default 16)\n"
+            "  -j JOBS     number of books converted in parallel (default: all cores)\n"
+            "  -o DIR      output directory for .8xv files (default .)\n"
+            "  -g          anti-aliased 2bpp glyphs instead of 1bpp\n"
+            "  -z          Huffman-code the text (smaller, slower to jump to a page)\n"
+            "  -r          also write a size and page cost report, <BASE>.report.json\n",
+            argv0);
+}
+
+int main(int argc, char **argv)
+{
+    const char *font_path = NULL;
+    context_t ctx = {
+        .pixel_size = 16,
+        .bpp = 1,
+        .output_dir = ".",
+    };
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+    while ((opt = getopt(argc, argv, "f:s:j:o:gzrh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f':
+            font_path = optarg;
+            break;
+        case 's':
+            ctx.pixel_size = atoi(optarg);
+            break;
+        case 'j':
+            jobs = atol(optarg);
+            break;
+        case 'o':
+            ctx.output_dir = optarg;
+            break;
+        case 'g':
+            ctx.bpp = 2;
+            break;
+        case 'z':
+            ctx.coded = 1;
+            break;
+        case 'r':
+            ctx.report = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (font_path == NULL || optind >= argc || ctx.pixel_size == 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    uint8_t *font_file = read_file(font_path, &ctx.font_size);
+    if (font_file == NULL)
+    {
+        return 1;
+    }
+    ctx.font_file = font_file;
+
+    ctx.job_count = argc - optind;
+    ctx.jobs = calloc(ctx.job_count, sizeof(job_t));
+    for (size_t i = 0; i < ctx.job_count; i++)
+    {
+        job_t *job = &ctx.jobs[i];
+        job->path = argv[optind + i];
+        job->status = -1;
+        make_title(job->path, job->title);
+        // base names must be unique within a batch, rehash on collision
+        for (unsigned int salt = 0;; salt++)
+        {
+            make_base_name(job->title, salt, job->base);
+            size_t j;
+            for (j = 0; j < i && strcmp(ctx.jobs[j].base, job->base) != 0; j++)
+            {
+            }
+            if (j == i)
+            {
+                break;
+            }
+        }
+    }
+
+    if (jobs < 1)
+    {
+        jobs = 1;
+    }
+    if ((size_t)jobs > ctx.job_count)
+    {
+        jobs = ctx.job_count;
+    }
+    pthread_t *threads = calloc(jobs, sizeof(pthread_t));
+    for (long i = 0; i < jobs; i++)
+    {
+        if (pthread_create(&threads[i], NULL, worker, &ctx) != 0)
+        {
+            fprintf(stderr, "qrconv: failed to start worker thread\n");
+            jobs = i;
+            break;
+        }
+    }
+    if (jobs == 0)
+    {
+        worker(&ctx);
+    }
+    for (long i = 0; i < jobs; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    int failed = 0;
+    for (size_t i = 0; i < ctx.job_count; i++)
+    {
+        if (ctx.jobs[i].status != 0)
+        {
+            fprintf(stderr, "qrconv: failed to convert %s\n", ctx.jobs[i].path);
+            failed++;
+        }
+    }
+    free(threads);
+    free(ctx.jobs);
+    free(font_file);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,278 @@
+#define QUICKRDR_HOST
+#include "../../src/quickrdr.h"
+
+#include "huffman.h"
+#include "report.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// default settings of the reader, see settings_choice in src/main.c
+#define READER_MARGIN 8
+#define READER_LINE_SPACING 2
+// text area of the reader, see src/textmode.h
+#define TEXT_WIDTH 320
+#define TEXT_HEIGHT 196
+
+typedef struct
+{
+    size_t sum;
+    size_t max;
+} page_cost_t;
+
+static void add_cost(page_cost_t *cost, size_t value)
+{
+    cost->sum += value;
+    if (value > cost->max)
+    {
+        cost->max = value;
+    }
+}
+
+static void write_cost(FILE *file, const char *name, const page_cost_t *cost, size_t page_count)
+{
+    fprintf(file, "\"%s\":{\"mean\":%.1f,\"max\":%zu}", name,
+            page_count ? (double)cost->sum / page_count : 0.0, cost->max);
+}
+
+int qrconv_write_report(const char *dir, const char *base, const char *title,
+                        const qrconv_book_t *book, const qrconv_book_stats_t *stats)
+{
+    const uint8_t *data = book->data.data;
+    size_t chunk_base[QRCONV_MAX_CHUNKS];
+    size_t total_size = 0;
+    size_t slack = 0;
+    for (size_t i = 0; i < book->chunk_count; i++)
+    {
+        chunk_base[i] = total_size;
+        total_size += book->chunk_size[i];
+        if (i + 1 < book->chunk_count)
+        {
+            slack += QUICKRDR_CHUNK_SIZE - book->chunk_size[i];
+        }
+    }
+#define AT(address) (data + chunk_base[(address) >> 16] + ((address) & 0xFFFF))
+    const quickrdr_header_t *header = (const quickrdr_header_t *)data;
+    const quickrdr_layout_t *layout = (const quickrdr_layout_t *)(header + 1);
+    uint8_t min_extension_byte = header->min_extension_byte;
+    size_t glyph_count = qrconv_get24(header->font_glyph_count.bytes);
+    size_t glyph_size = header->font_glyph_size;
+    size_t block_count = qrconv_get24(header->page_count.bytes);
+    uint32_t page_table = qrconv_get24(layout->page_table.bytes);
+    uint32_t glyph_table = qrconv_get24(layout->glyph_table.bytes);
+    // version 6 streams are decoded with the code after chunk_hash[]
+    const quickrdr_code_t *code = NULL;
+    uint16_t length_count[QUICKRDR_MAX_CODE_LENGTH];
+    uint16_t *symbols = NULL;
+    size_t symbol_count = 0;
+    if (header->version == 6)
+    {
+        code = (const quickrdr_code_t *)((const uint8_t *)(layout + 1) +
+                                         book->chunk_count * (sizeof(uint16_t) + sizeof(uint32_t)));
+        for (size_t i = 0; i < QUICKRDR_MAX_CODE_LENGTH; i++)
+        {
+            length_count[i] = qrconv_get16((const uint8_t *)&code->length_count[i]);
+            symbol_count += length_count[i];
+        }
+        symbols = qrconv_xmalloc((symbol_count + 1) * sizeof(uint16_t));
+        uint32_t symbol_table = qrconv_get24(code->symbol_table.bytes);
+        for (size_t i = 0; i < symbol_count; i++)
+        {
+            symbols[i] = qrconv_get16(AT(qrconv_table_record(symbol_table, sizeof(uint16_t), i)));
+        }
+    }
+
+    uint8_t *widths = calloc(65536, 1);
+    for (size_t i = 0; i < glyph_count; i++)
+    {
+        const uint8_t *glyph = AT(qrconv_table_record(glyph_table, glyph_size, i));
+        widths[qrconv_get16(glyph)] = glyph[offsetof(quickrdr_glyph_t, width)];
+    }
+
+    // the stream as glyph IDs, with the appvar each one is stored in
+    // a coded block holds at most QUICKRDR_BLOCK_SIZE glyph IDs, a glyph ID
+    // takes at least a byte otherwise
+    size_t stream_size = header->version == 6 ? block_count * QUICKRDR_BLOCK_SIZE : total_size;
+    uint16_t *ids = qrconv_xmalloc(stream_size * sizeof(uint16_t));
+    uint8_t *chunk_of = qrconv_xmalloc(stream_size);
+    size_t count = 0;
+    size_t one_byte_refs = 0;
+    size_t two_byte_refs = 0;
+    size_t paragraph_breaks = 0;
+    size_t coded_text = 0;
+    for (size_t i = 0; i < block_count; i++)
+    {
+        uint32_t address = qrconv_get24(AT(qrconv_table_record(page_table, sizeof(uint24_t), i)));
+        uint32_t chunk = address >> 16;
+        size_t end = book->chunk_size[chunk];
+        if (i + 1 < block_count)
+        {
+            uint32_t next = qrconv_get24(AT(qrconv_table_record(page_table, sizeof(uint24_t), i + 1)));
+            if (next >> 16 == chunk)
+            {
+                end = next & 0xFFFF;
+            }
+        }
+        const uint8_t *block = data + chunk_base[chunk];
+        if (code != NULL)
+        {
+            size_t size = end - (address & 0xFFFF);
+            size_t decoded = qrconv_decode_block(length_count, symbols, block + (address & 0xFFFF), size, ids + count);
+            if (decoded == (size_t)-1)
+            {
+                fprintf(stderr, "qrconv: %s: invalid block %zu\n", title, i);
+                decoded = 0;
+            }
+            coded_text += size;
+            for (size_t j = 0; j < decoded; j++)
+            {
+                chunk_of[count] = chunk;
+                uint16_t id = ids[count++];
+                // what the glyph ID would take in a version 4 book
+                if (id > 0xFF)
+                {
+                    two_byte_refs++;
+                }
+                else if (id == 0)
+                {
+                    paragraph_breaks++;
+                }
+                else
+                {
+                    one_byte_refs++;
+                }
+            }
+            continue;
+        }
+        for (size_t j = address & 0xFFFF; j < end; j++)
+        {
+            uint16_t id = block[j];
+            if (min_extension_byte != 0 && id >= min_extension_byte)
+            {
+                id = (id << 8) | block[++j];
+                two_byte_refs++;
+            }
+            else if (id == 0)
+            {
+                paragraph_breaks++;
+            }
+            else
+            {
+                one_byte_refs++;
+            }
+            chunk_of[count] = chunk;
+            ids[count++] = id;
+        }
+    }
+    free(symbols);
+    size_t byte_coded_text = one_byte_refs + 2 * two_byte_refs + paragraph_breaks;
+    if (code != NULL)
+    {
+        one_byte_refs = two_byte_refs = paragraph_breaks = 0;
+    }
+#undef AT
+
+    // pages laid out like reflow_page() in src/reflow.c
+    unsigned int width = TEXT_WIDTH - 2 * READER_MARGIN;
+    unsigned int line_height = header->line_height + READER_LINE_SPACING;
+    unsigned int lines = (TEXT_HEIGHT - 2 * READER_MARGIN) / (line_height ? line_height : 1);
+    if (lines == 0)
+    {
+        lines = 1;
+    }
+    page_cost_t lookups = {0};
+    page_cost_t copied = {0};
+    page_cost_t crossings = {0};
+    size_t page_count = 0;
+    size_t position = 0;
+    while (position < count)
+    {
+        unsigned int page_lines = 0;
+        size_t page_lookups = 0;
+        size_t page_bytes = 0;
+        size_t page_crossings = 0;
+        size_t start = position;
+        while (position < count && page_lines < lines)
+        {
+            unsigned int line_width = 0;
+            int open = 0;
+            while (position < count)
+            {
+                uint16_t id = ids[position];
+                unsigned int glyph_width = id ? widths[id] : 0;
+                if (id && open && line_width + glyph_width > width)
+                {
+                    break;
+                }
+                if (!open)
+                {
+                    if (page_lines)
+                    {
+                        page_bytes++;
+                    }
+                    open = 1;
+                }
+                if (position > start && chunk_of[position] != chunk_of[position - 1])
+                {
+                    page_crossings++;
+                }
+                position++;
+                if (id == 0)
+                {
+                    break;
+                }
+                page_bytes += id > 0xFF ? 2 : 1;
+                page_lookups++;
+                line_width += glyph_width;
+            }
+            if (open)
+            {
+                page_lines++;
+            }
+        }
+        add_cost(&lookups, page_lookups);
+        add_cost(&copied, page_bytes);
+        add_cost(&crossings, page_crossings);
+        page_count++;
+    }
+    free(widths);
+    free(ids);
+    free(chunk_of);
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s.report.json", dir, base);
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    size_t glyph_table_size = glyph_count * glyph_size;
+    fputs("{\"title\":", file);
+    qrconv_write_json_string(file, title);
+    fprintf(file, ",\"version\":%u,\"appVars\":%zu,\"totalBytes\":%zu,", header->version, book->chunk_count, total_size);
+    fprintf(file, "\"sections\":{\"header\":%zu,\"pageTable\":%zu,\"glyphs\":%zu,\"glyphPadding\":%zu,"
+                  "\"oneByteRefs\":%zu,\"twoByteRefs\":%zu,\"paragraphBreaks\":%zu,\"symbolTable\":%zu,\"codedText\":%zu},",
+            sizeof(quickrdr_header_t) + sizeof(quickrdr_layout_t) + book->chunk_count * (sizeof(uint16_t) + sizeof(uint32_t)) +
+                (code != NULL ? sizeof(quickrdr_code_t) : 0),
+            block_count * sizeof(uint24_t), glyph_table_size - stats->glyph_padding, stats->glyph_padding,
+            one_byte_refs, 2 * two_byte_refs, paragraph_breaks, symbol_count * sizeof(uint16_t), coded_text);
+    fprintf(file, "\"byteCodedText\":%zu,", byte_coded_text);
+    fprintf(file, "\"glyphCount\":%zu,\"glyphSize\":%zu,\"appVarSlack\":%zu,", glyph_count, glyph_size, slack);
+    fprintf(file, "\"pages\":{\"margin\":%d,\"lineSpacing\":%d,\"lines\":%u,\"count\":%zu,",
+            READER_MARGIN, READER_LINE_SPACING, lines, page_count);
+    write_cost(file, "glyphLookups", &lookups, page_count);
+    fputc(',', file);
+    write_cost(file, "bytesCopied", &copied, page_count);
+    fputc(',', file);
+    write_cost(file, "chunkCrossings", &crossings, page_count);
+    fputs("}}\n", file);
+    if (fclose(file) != 0)
+    {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
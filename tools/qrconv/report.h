@@ -0,0 +1,12 @@
+#pragma once
+
+#include "book.h"
+
+/**
+ * Writes `<base>.report.json` to `dir`: the bytes of each section of the book
+ * and the estimated cost of its pages on the calculator, the same report as
+ * analyzeBook() in website/src/convert/report.ts.
+ * @returns 0 on success, -1 on failure
+ */
+int qrconv_write_report(const char *dir, const char *base, const char *title,
+                        const qrconv_book_t *book, const qrconv_book_stats_t *stats);
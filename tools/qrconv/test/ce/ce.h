@@ -0,0 +1,32 @@
+// Stand-ins for the CE toolchain, so that src/quickrdr.c builds on the host.
+// It is compiled as C++ because uint24_t has to be a 3-byte integer, like on
+// the eZ80, for the structs of quickrdr.h to keep their layout.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct uint24_t
+{
+    uint8_t bytes[3]; // little-endian
+
+    uint24_t() = default;
+    uint24_t(uint32_t value) : bytes{(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16)} {}
+    operator uint32_t() const { return bytes[0] | bytes[1] << 8 | (uint32_t)bytes[2] << 16; }
+    uint24_t &operator++() { return *this = *this + 1; }
+    uint24_t operator++(int)
+    {
+        uint24_t old = *this;
+        *this = *this + 1;
+        return old;
+    }
+    uint24_t &operator--() { return *this = *this - 1; }
+    uint24_t &operator+=(uint32_t value) { return *this = *this + value; }
+    uint24_t &operator-=(uint32_t value) { return *this = *this - value; }
+    uint24_t &operator|=(uint32_t value) { return *this = *this | value; }
+};
+typedef int32_t int24_t;
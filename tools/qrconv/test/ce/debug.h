@@ -0,0 +1,3 @@
+#pragma once
+
+#define dbg_printf(...) ((void)0)
@@ -0,0 +1,23 @@
+// The part of fileioc that src/quickrdr.c uses, over appvars loaded from
+// .8xv files with host_load_appvars(). Every appvar is read-only.
+#pragma once
+
+#include "ce.h"
+
+uint8_t ti_Open(const char *name, const char *mode);
+int ti_Close(uint8_t handle);
+size_t ti_Read(void *data, size_t size, size_t count, uint8_t handle);
+int ti_Seek(int offset, unsigned int origin, uint8_t handle);
+void *ti_GetDataPtr(uint8_t handle);
+uint16_t ti_GetSize(uint8_t handle);
+char *ti_Detect(void **state, const char *detect);
+
+/**
+ * Replaces the appvars by those of the .8xv files in `dir`.
+ * @returns the number of appvars loaded, -1 if `dir` cannot be read
+ */
+int host_load_appvars(const char *dir);
+/**
+ * @returns the name of the first loaded appvar that ends in "00", or NULL
+ */
+const char *host_find_book(void);
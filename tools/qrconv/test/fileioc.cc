@@ -0,0 +1,166 @@
+// Appvars from .8xv files for the host build of src/quickrdr.c
+
+#include "fileioc.h"
+
+#include <dirent.h>
+
+#include <string>
+#include <vector>
+
+namespace
+{
+struct appvar
+{
+    std::string name;
+    std::vector<uint8_t> data;
+};
+
+struct handle
+{
+    const appvar *var;
+    size_t offset;
+};
+
+std::vector<appvar> appvars;
+handle handles[8]; // 0 is not a handle
+
+// an .8xv file is a 55-byte file header, a variable entry with the name at
+// offset 5 and the data size at offset 17, and a 2-byte checksum
+bool load(const std::string &path)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    std::vector<uint8_t> bytes;
+    uint8_t buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        bytes.insert(bytes.end(), buffer, buffer + read);
+    }
+    fclose(file);
+    if (bytes.size() < 74)
+    {
+        return false;
+    }
+    size_t size = bytes[72] | bytes[73] << 8;
+    if (bytes.size() < 74 + size)
+    {
+        return false;
+    }
+    appvar var;
+    var.name.assign((const char *)&bytes[60], strnlen((const char *)&bytes[60], 8));
+    var.data.assign(bytes.begin() + 74, bytes.begin() + 74 + size);
+    appvars.push_back(var);
+    return true;
+}
+} // namespace
+
+int host_load_appvars(const char *dir)
+{
+    DIR *entries = opendir(dir);
+    if (entries == NULL)
+    {
+        return -1;
+    }
+    appvars.clear();
+    memset(handles, 0, sizeof(handles));
+    struct dirent *entry;
+    while ((entry = readdir(entries)) != NULL)
+    {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".8xv") == 0)
+        {
+            load(std::string(dir) + "/" + name);
+        }
+    }
+    closedir(entries);
+    return appvars.size();
+}
+
+const char *host_find_book(void)
+{
+    for (const appvar &var : appvars)
+    {
+        if (var.name.size() > 2 && var.name.compare(var.name.size() - 2, 2, "00") == 0)
+        {
+            return var.name.c_str();
+        }
+    }
+    return NULL;
+}
+
+uint8_t ti_Open(const char *name, const char *mode)
+{
+    if (strcmp(mode, "r") != 0)
+    {
+        return 0;
+    }
+    for (const appvar &var : appvars)
+    {
+        if (var.name == name)
+        {
+            for (uint8_t i = 1; i < sizeof(handles) / sizeof(handles[0]); i++)
+            {
+                if (handles[i].var == NULL)
+                {
+                    handles[i] = {&var, 0};
+                    return i;
+                }
+            }
+            return 0;
+        }
+    }
+    return 0;
+}
+
+int ti_Close(uint8_t handle)
+{
+    handles[handle].var = NULL;
+    return 1;
+}
+
+size_t ti_Read(void *data, size_t size, size_t count, uint8_t handle)
+{
+    struct handle *h = &handles[handle];
+    size_t read = 0;
+    while (read < count && h->offset + size <= h->var->data.size())
+    {
+        memcpy((uint8_t *)data + read * size, &h->var->data[h->offset], size);
+        h->offset += size;
+        read++;
+    }
+    return read;
+}
+
+int ti_Seek(int offset, unsigned int origin, uint8_t handle)
+{
+    struct handle *h = &handles[handle];
+    long base = origin == SEEK_SET ? 0 : origin == SEEK_CUR ? (long)h->offset : (long)h->var->data.size();
+    if (base + offset < 0 || base + offset > (long)h->var->data.size())
+    {
+        return EOF;
+    }
+    h->offset = base + offset;
+    return 0;
+}
+
+void *ti_GetDataPtr(uint8_t handle)
+{
+    struct handle *h = &handles[handle];
+    return (void *)(h->var->data.data() + h->offset);
+}
+
+uint16_t ti_GetSize(uint8_t handle)
+{
+    return handles[handle].var->data.size();
+}
+
+char *ti_Detect(void **state, const char *detect)
+{
+    (void)state;
+    (void)detect;
+    return NULL;
+}
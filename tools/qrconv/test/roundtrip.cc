@@ -0,0 +1,261 @@
+// Round trip of the glyph stream: text converted by qrconv and read back by
+// the reader's cursor code (src/quickrdr.c).
+//
+//   roundtrip text FILE      writes the test text
+//   roundtrip check FILE DIR...
+//
+// The first DIR must hold the book converted without -z (version 4 or 5).
+// Its glyph IDs must follow the text: every character gets one ID and every
+// line break a 0. The books in the other DIRs, converted with other options,
+// must read as the same IDs, and seeking to positions told by the cursor must
+// continue with the same IDs.
+
+#include "fileioc.h"
+
+#include "quickrdr.h"
+
+#include <math.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace
+{
+// about 600 characters from Latin, Greek and Cyrillic
+std::vector<uint32_t> alphabet()
+{
+    std::vector<uint32_t> chars;
+    for (uint32_t c = 0x20; c < 0x7F; c++)
+    {
+        chars.push_back(c);
+    }
+    for (uint32_t c = 0xC0; c < 0x250; c++)
+    {
+        chars.push_back(c);
+    }
+    for (uint32_t c = 0x391; c < 0x3CA; c++)
+    {
+        if (c != 0x3A2)
+        {
+            chars.push_back(c);
+        }
+    }
+    for (uint32_t c = 0x410; c < 0x450; c++)
+    {
+        chars.push_back(c);
+    }
+    return chars;
+}
+
+void put_utf8(std::string &out, uint32_t c)
+{
+    if (c < 0x80)
+    {
+        out += (char)c;
+    }
+    else if (c < 0x800)
+    {
+        out += (char)(0xC0 | c >> 6);
+        out += (char)(0x80 | (c & 0x3F));
+    }
+    else
+    {
+        out += (char)(0xE0 | c >> 12);
+        out += (char)(0x80 | (c >> 6 & 0x3F));
+        out += (char)(0x80 | (c & 0x3F));
+    }
+}
+
+int write_text(const char *path)
+{
+    std::vector<uint32_t> chars = alphabet();
+    std::string text;
+    uint32_t state = 1;
+    for (int i = 0; i < 200000; i++)
+    {
+        state = state * 1103515245 + 12345;
+        uint32_t r = state >> 8 & 0xFFFF;
+        if (r % 97 == 0)
+        {
+            // Windows line breaks too, the '\r' is dropped
+            text += r & 0x100 ? "\r\n" : "\n";
+            continue;
+        }
+        // geometric frequencies: several hundred distinct characters, so that
+        // the book needs 2-byte IDs, and rare ones that get the longest codes
+        double u = (r + 1) / 65537.0;
+        put_utf8(text, chars[(size_t)(-log(u) * chars.size() / 12)]);
+    }
+    FILE *file = fopen(path, "wb");
+    if (file == NULL || fwrite(text.data(), 1, text.size(), file) != text.size())
+    {
+        fprintf(stderr, "Failed to write %s\n", path);
+        return 1;
+    }
+    fclose(file);
+    return 0;
+}
+
+// the text as qrconv sees it: a code point per character, 0 for a line break
+bool read_text(const char *path, std::vector<uint32_t> &out)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    std::string text;
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        text.append(buffer, read);
+    }
+    fclose(file);
+    for (size_t i = 0; i < text.size();)
+    {
+        uint8_t byte = text[i];
+        int extra = byte < 0x80 ? 0 : byte < 0xE0 ? 1 : byte < 0xF0 ? 2 : 3;
+        uint32_t c = extra == 0 ? byte : byte & (0x3F >> extra);
+        for (int j = 1; j <= extra; j++)
+        {
+            c = c << 6 | (text[i + j] & 0x3F);
+        }
+        i += 1 + extra;
+        if (c != '\r')
+        {
+            out.push_back(c == '\n' ? 0 : c);
+        }
+    }
+    return true;
+}
+
+struct stream
+{
+    unsigned int version;
+    std::vector<uint16_t> ids;
+    std::vector<std::pair<uint24_t, size_t>> positions; // a sample of (position, index of the next ID)
+};
+
+bool read_stream(const char *dir, stream &out)
+{
+    if (host_load_appvars(dir) <= 0 || host_find_book() == NULL)
+    {
+        fprintf(stderr, "%s: no book\n", dir);
+        return false;
+    }
+    quickrdr_book_handle_t book = quickrdr_open_book(host_find_book());
+    if (book == NULL)
+    {
+        fprintf(stderr, "%s: quickrdr_open_book() failed\n", dir);
+        return false;
+    }
+    out.version = book->header.version;
+    quickrdr_cursor_t cursor;
+    quickrdr_cursor_begin(book, &cursor);
+    uint16_t id;
+    for (;;)
+    {
+        if (out.ids.size() % 997 == 0)
+        {
+            out.positions.push_back({quickrdr_cursor_tell(book, &cursor), out.ids.size()});
+        }
+        if (!quickrdr_cursor_next(book, &cursor, &id))
+        {
+            break;
+        }
+        out.ids.push_back(id);
+    }
+    bool ok = quickrdr_cursor_tell(book, &cursor) == QUICKRDR_STREAM_END;
+    if (!ok)
+    {
+        fprintf(stderr, "%s: the stream ends before QUICKRDR_STREAM_END\n", dir);
+    }
+    for (const auto &[position, index] : out.positions)
+    {
+        if (!quickrdr_cursor_seek(book, &cursor, position))
+        {
+            fprintf(stderr, "%s: cannot seek to %u\n", dir, (unsigned int)position);
+            ok = false;
+            continue;
+        }
+        for (size_t i = index; i < index + 16 && i < out.ids.size(); i++)
+        {
+            if (!quickrdr_cursor_next(book, &cursor, &id) || id != out.ids[i])
+            {
+                fprintf(stderr, "%s: ID %zu read after seeking to %u differs\n", dir, i, (unsigned int)position);
+                ok = false;
+                break;
+            }
+        }
+    }
+    quickrdr_close_book(book);
+    return ok;
+}
+
+// glyph IDs follow the text if each character always gets the same ID and
+// no two characters share one
+bool check_ids(const char *dir, const std::vector<uint32_t> &text, const std::vector<uint16_t> &ids)
+{
+    if (ids.size() != text.size())
+    {
+        fprintf(stderr, "%s: %zu glyph IDs for %zu characters\n", dir, ids.size(), text.size());
+        return false;
+    }
+    std::map<uint32_t, uint16_t> id_of;
+    std::map<uint16_t, uint32_t> char_of;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        uint16_t id = id_of.emplace(text[i], ids[i]).first->second;
+        uint32_t c = char_of.emplace(ids[i], text[i]).first->second;
+        if ((text[i] == 0) != (ids[i] == 0) || id != ids[i] || c != text[i])
+        {
+            fprintf(stderr, "%s: glyph ID %zu (%u) does not match U+%04X\n", dir, i, ids[i], text[i]);
+            return false;
+        }
+    }
+    printf("%s: %zu distinct glyph IDs\n", dir, id_of.size() - 1);
+    return true;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc == 3 && strcmp(argv[1], "text") == 0)
+    {
+        return write_text(argv[2]);
+    }
+    if (argc < 4 || strcmp(argv[1], "check") != 0)
+    {
+        fprintf(stderr, "usage: %s text FILE | check FILE DIR...\n", argv[0]);
+        return 2;
+    }
+    std::vector<uint32_t> text;
+    if (!read_text(argv[2], text))
+    {
+        fprintf(stderr, "Failed to read %s\n", argv[2]);
+        return 1;
+    }
+    int failed = 0;
+    stream first;
+    for (int i = 3; i < argc; i++)
+    {
+        stream current;
+        bool ok = read_stream(argv[i], current);
+        if (i == 3)
+        {
+            ok = ok && check_ids(argv[i], text, current.ids);
+            first = current;
+        }
+        else if (current.ids != first.ids)
+        {
+            fprintf(stderr, "%s: glyph IDs differ from %s\n", argv[i], argv[3]);
+            ok = false;
+        }
+        printf("%s: version %u, %zu glyph IDs, %zu seeks, %s\n", argv[i], current.version, current.ids.size(),
+               current.positions.size(), ok ? "ok" : "FAILED");
+        failed += !ok;
+    }
+    return failed != 0;
+}
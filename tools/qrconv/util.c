@@ -0,0 +1,158 @@
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAP_EMPTY UINT32_MAX
+
+void *qrconv_xmalloc(size_t size)
+{
+    void *ptr = malloc(size ? size : 1);
+    if (ptr == NULL)
+    {
+        fprintf(stderr, "qrconv: out of memory\n");
+        abort();
+    }
+    return ptr;
+}
+
+void *qrconv_xrealloc(void *ptr, size_t size)
+{
+    ptr = realloc(ptr, size ? size : 1);
+    if (ptr == NULL)
+    {
+        fprintf(stderr, "qrconv: out of memory\n");
+        abort();
+    }
+    return ptr;
+}
+
+void qrconv_buf_reserve(qrconv_buf_t *buf, size_t capacity)
+{
+    if (capacity <= buf->capacity)
+    {
+        return;
+    }
+    size_t new_capacity = buf->capacity ? buf->capacity : 256;
+    while (new_capacity < capacity)
+    {
+        new_capacity *= 2;
+    }
+    buf->data = qrconv_xrealloc(buf->data, new_capacity);
+    buf->capacity = new_capacity;
+}
+
+void qrconv_buf_append(qrconv_buf_t *buf, const void *data, size_t size)
+{
+    qrconv_buf_reserve(buf, buf->size + size);
+    memcpy(buf->data + buf->size, data, size);
+    buf->size += size;
+}
+
+void qrconv_buf_push(qrconv_buf_t *buf, uint8_t byte)
+{
+    qrconv_buf_reserve(buf, buf->size + 1);
+    buf->data[buf->size++] = byte;
+}
+
+void qrconv_buf_free(qrconv_buf_t *buf)
+{
+    free(buf->data);
+    buf->data = NULL;
+    buf->size = buf->capacity = 0;
+}
+
+static size_t map_slot(uint32_t key, size_t capacity)
+{
+    // capacity is always a power of two
+    return (key * 2654435761U) & (capacity - 1);
+}
+
+static void map_grow(qrconv_map_t *map)
+{
+    size_t old_capacity = map->capacity;
+    uint32_t *old_keys = map->keys;
+    size_t *old_values = map->values;
+    map->capacity = old_capacity ? old_capacity * 2 : 1024;
+    map->keys = qrconv_xmalloc(map->capacity * sizeof(uint32_t));
+    map->values = qrconv_xmalloc(map->capacity * sizeof(size_t));
+    memset(map->keys, 0xFF, map->capacity * sizeof(uint32_t));
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (old_keys[i] == MAP_EMPTY)
+        {
+            continue;
+        }
+        size_t slot = map_slot(old_keys[i], map->capacity);
+        while (map->keys[slot] != MAP_EMPTY)
+        {
+            slot = (slot + 1) & (map->capacity - 1);
+        }
+        map->keys[slot] = old_keys[i];
+        map->values[slot] = old_values[i];
+    }
+    free(old_keys);
+    free(old_values);
+}
+
+size_t *qrconv_map_find(const qrconv_map_t *map, uint32_t key)
+{
+    if (map->capacity == 0)
+    {
+        return NULL;
+    }
+    size_t slot = map_slot(key, map->capacity);
+    while (map->keys[slot] != MAP_EMPTY)
+    {
+        if (map->keys[slot] == key)
+        {
+            return &map->values[slot];
+        }
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+    return NULL;
+}
+
+size_t *qrconv_map_get(qrconv_map_t *map, uint32_t key, size_t fallback)
+{
+    size_t *value = qrconv_map_find(map, key);
+    if (value != NULL)
+    {
+        return value;
+    }
+    if ((map->count + 1) * 2 > map->capacity)
+    {
+        map_grow(map);
+    }
+    size_t slot = map_slot(key, map->capacity);
+    while (map->keys[slot] != MAP_EMPTY)
+    {
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+    map->keys[slot] = key;
+    map->values[slot] = fallback;
+    map->count++;
+    return &map->values[slot];
+}
+
+void qrconv_map_free(qrconv_map_t *map)
+{
+    free(map->keys);
+    free(map->values);
+    memset(map, 0, sizeof(*map));
+}
+
+void qrconv_write_json_string(FILE *file, const char *string)
+{
+    fputc('"', file);
+    for (const char *c = string; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fputc('\\', file);
+        }
+        fputc(*c, file);
+    }
+    fputc('"', file);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct
+{
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} qrconv_buf_t;
+
+void qrconv_buf_reserve(qrconv_buf_t *buf, size_t capacity);
+void qrconv_buf_append(qrconv_buf_t *buf, const void *data, size_t size);
+void qrconv_buf_push(qrconv_buf_t *buf, uint8_t byte);
+void qrconv_buf_free(qrconv_buf_t *buf);
+
+// open-addressing map from code points to indices
+typedef struct
+{
+    uint32_t *keys;
+    size_t *values;
+    size_t capacity;
+    size_t count;
+} qrconv_map_t;
+
+/**
+ * @returns pointer to the value for key, inserting it as `fallback` if missing
+ */
+size_t *qrconv_map_get(qrconv_map_t *map, uint32_t key, size_t fallback);
+/**
+ * @returns pointer to the value for key, or NULL if missing
+ */
+size_t *qrconv_map_find(const qrconv_map_t *map, uint32_t key);
+void qrconv_map_free(qrconv_map_t *map);
+
+void *qrconv_xmalloc(size_t size);
+void *qrconv_xrealloc(void *ptr, size_t size);
+
+// writes a quoted JSON string
+void qrconv_write_json_string(FILE *file, const char *string);
+
+static inline void qrconv_put24(uint8_t *dst, uint32_t value)
+{
+    dst[0] = value & 0xFF;
+    dst[1] = (value >> 8) & 0xFF;
+    dst[2] = (value >> 16) & 0xFF;
+}
+
+static inline void qrconv_put16(uint8_t *dst, uint16_t value)
+{
+    dst[0] = value & 0xFF;
+    dst[1] = value >> 8;
+}
+
+static inline uint32_t qrconv_get24(const uint8_t *src)
+{
+    return src[0] | (src[1] << 8) | ((uint32_t)src[2] << 16);
+}
+
+static inline uint16_t qrconv_get16(const uint8_t *src)
+{
+    return src[0] | (src[1] << 8);
+}
+
+static inline void qrconv_put32(uint8_t *dst, uint32_t value)
+{
+    qrconv_put16(dst, value & 0xFFFF);
+    qrconv_put16(dst + 2, value >> 16);
+}
+
+// 32-bit FNV-1a, same as fnv1a() in website/src/convert/ti.ts
+static inline uint32_t qrconv_fnv1a(const uint8_t *data, size_t size)
+{
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619U;
+    }
+    return hash;
+}
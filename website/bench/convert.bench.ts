@@ -0,0 +1,22 @@
+import { bench, describe } from 'vitest'
+import { corpora } from './corpus'
+import { prepare, stages, type StageName } from './stages'
+
+// Each stage is benchmarked on its own, with the output of the stages before
+// it prepared once up front. The single-run report gives throughput against
+// the input size and the memory each stage needs.
+for (const corpus of corpora) {
+  const { prepared, report } = await prepare(corpus)
+  const title = `${corpus.name} (${(prepared.bytes / 1024).toFixed(0)} KiB, ${prepared.glyphs.length} glyphs, ` +
+    `${prepared.blocks.length} blocks, ${prepared.chunks.length} appvars)`
+  console.log(title)
+  console.table(report)
+
+  describe(title, () => {
+    for (const stage of Object.keys(stages) as StageName[]) {
+      bench(stage, async () => {
+        await stages[stage](prepared)
+      }, { time: 1000, warmupIterations: 1 })
+    }
+  })
+}
@@ -0,0 +1,66 @@
+// Synthetic books for the converter benchmarks. Everything is generated from
+// a fixed seed so runs are comparable.
+
+export interface Corpus {
+  name: string
+  text: string
+}
+
+// mulberry32
+function random(seed: number): () => number {
+  return () => {
+    seed = (seed + 0x6d2b79f5) | 0
+    let t = Math.imul(seed ^ (seed >>> 15), 1 | seed)
+    t = (t + Math.imul(t ^ (t >>> 7), 61 | t)) ^ t
+    return ((t ^ (t >>> 14)) >>> 0) / 4294967296
+  }
+}
+
+const words = (
+  'lorem ipsum dolor sit amet consectetur adipiscing elit sed do eiusmod tempor incididunt ut labore et ' +
+  'dolore magna aliqua enim ad minim veniam quis nostrud exercitation ullamco laboris nisi aliquip ex ea ' +
+  'commodo consequat duis aute irure in reprehenderit voluptate velit esse cillum fugiat nulla pariatur ' +
+  'excepteur sint occaecat cupidatat non proident sunt culpa qui officia deserunt mollit anim id est laborum'
+).split(' ')
+
+function latinProse(seed: number, length: number): string {
+  const next = random(seed)
+  const parts: string[] = []
+  let size = 0
+  while (size < length) {
+    const sentence = []
+    const count = 4 + Math.floor(next() * 14)
+    for (let i = 0; i < count; i++) {
+      sentence.push(words[Math.floor(next() * words.length)])
+    }
+    let text = sentence.join(' ')
+    text = text[0].toUpperCase() + text.substring(1) + (next() < 0.2 ? '.\n\n' : '. ')
+    parts.push(text)
+    size += text.length
+  }
+  return parts.join('').substring(0, length)
+}
+
+// `distinct` ideographs with a Zipf-like distribution, so that the most
+// frequent ones get 1-byte IDs and the long tail needs 2-byte IDs
+function cjkText(seed: number, length: number, distinct: number): string {
+  const next = random(seed)
+  const chars: string[] = []
+  for (let i = 0; i < length; i++) {
+    if (next() < 0.01) {
+      chars.push('\n')
+      continue
+    }
+    const rank = Math.floor(Math.pow(distinct, next()))
+    chars.push(String.fromCodePoint(0x4e00 + rank - 1))
+  }
+  return chars.join('')
+}
+
+export const corpora: Corpus[] = [
+  { name: 'short Latin', text: latinProse(1, 4 * 1024) },
+  { name: 'Latin prose', text: latinProse(2, 5 * 1024 * 1024) },
+  { name: 'CJK', text: cjkText(3, 300 * 1024, 6000) },
+  // no line breaks and no spaces, every line is broken by width alone
+  { name: 'single line', text: 'abcdefghijklmnopqrstuvwxyz'.repeat(40 * 1024) },
+]
@@ -0,0 +1,99 @@
+import { calcMinExtensionByte, GlyphDiscovery } from '@/convert/convert'
+import { QuickRDRFile, type QuickRDRGlyph } from '@/convert/structs'
+import { codeBlocks } from '@/convert/huffman'
+import { encodeStream } from '@/convert/stream'
+import { convertChunksToAppVars } from '@/convert/ti'
+import type { Corpus } from './corpus'
+import { StubFont } from './stubFont'
+
+export const font = new StubFont()
+
+// inputs of each stage, from running the stages before it once
+export interface Prepared {
+  corpus: Corpus
+  bytes: number
+  discovery: GlyphDiscovery
+  ids: Map<string, number>
+  glyphs: QuickRDRGlyph[]
+  lineHeight: number
+  text: number[]
+  blocks: Uint8Array[]
+  file: QuickRDRFile
+  chunks: Uint8Array[]
+}
+
+export const stages = {
+  'glyph discovery': async (p: Prepared) => {
+    const discovery = new GlyphDiscovery(font)
+    await discovery.add(p.corpus.text)
+    return discovery
+  },
+  getGlyphID: (p: Prepared) => p.discovery.assignIDs(),
+  encodeStream: (p: Prepared) => encodeStream(p.text),
+  codeBlocks: (p: Prepared) => codeBlocks(p.blocks, calcMinExtensionByte(p.glyphs.length)),
+  'QuickRDRFile.asChunks': (p: Prepared) => p.file.asChunks(),
+  convertChunksToAppVars: (p: Prepared) => convertChunksToAppVars(p.chunks, 'BENCH'),
+}
+
+export type StageName = keyof typeof stages
+
+export interface StageReport {
+  stage: StageName
+  ms: number
+  'MB/s': number // of input text
+  'heap Δ MB': number
+  'peak RSS MB': number
+}
+
+const MB = 1024 * 1024
+
+function heapUsed(): number {
+  const usage = process.memoryUsage()
+  return usage.heapUsed + usage.arrayBuffers
+}
+
+/**
+ * Runs every stage once, in order, recording its time and memory. The heap
+ * is collected before each stage when node runs with --expose-gc, so "heap Δ"
+ * is what the stage allocated and did not get collected while it ran. Peak
+ * RSS is the process-wide high-water mark after the stage.
+ */
+export async function prepare(corpus: Corpus): Promise<{ prepared: Prepared, report: StageReport[] }> {
+  const p = { corpus, bytes: new TextEncoder().encode(corpus.text).byteLength } as Prepared
+  const report: StageReport[] = []
+  const measure = async <T>(stage: StageName, run: () => T | Promise<T>): Promise<T> => {
+    (globalThis as { gc?: () => void }).gc?.()
+    const before = heapUsed()
+    const start = performance.now()
+    const result = await run()
+    const ms = performance.now() - start
+    report.push({
+      stage,
+      ms: Math.round(ms * 10) / 10,
+      'MB/s': Math.round((p.bytes / MB / (Math.max(ms, 0.01) / 1000)) * 10) / 10,
+      'heap Δ MB': Math.round(((heapUsed() - before) / MB) * 10) / 10,
+      'peak RSS MB': Math.round(process.resourceUsage().maxRSS / 1024),
+    })
+    return result
+  }
+
+  p.discovery = await measure('glyph discovery', () => stages['glyph discovery'](p))
+  const { ids, glyphs, lineHeight } = await measure('getGlyphID', () => stages.getGlyphID(p))
+  p.ids = ids
+  p.glyphs = glyphs
+  p.lineHeight = lineHeight
+  // same mapping as the second pass of convertStreamToQuickRDR()
+  p.text = []
+  for (const char of corpus.text) {
+    const id = char == '\n' ? 0 : ids.get(char)
+    if (id !== undefined) {
+      p.text.push(id)
+    }
+  }
+  p.blocks = await measure('encodeStream', () => stages.encodeStream(p))
+  await measure('codeBlocks', () => stages.codeBlocks(p))
+  p.file = new QuickRDRFile(4, corpus.name, calcMinExtensionByte(glyphs.length), lineHeight, glyphs, p.blocks)
+  p.chunks = await measure('QuickRDRFile.asChunks', () => stages['QuickRDRFile.asChunks'](p))
+  await measure('convertChunksToAppVars', () => stages.convertChunksToAppVars(p))
+  return { prepared: p, report }
+}
@@ -0,0 +1,21 @@
+import type { Font, Glyph } from '@/convert/font'
+
+/**
+ * Font that makes up glyphs instead of rasterizing them, so the converter can
+ * be benchmarked without a canvas. Sizes are close to unifont at 16px: wide
+ * glyphs for CJK, narrower ones for everything else.
+ */
+export class StubFont implements Font {
+  readonly bpp = 1
+
+  async getGlyph(text: string): Promise<Glyph | null> {
+    const codepoint = text.codePointAt(0)!
+    if (codepoint < 0x20) {
+      return null
+    }
+    const width = codepoint >= 0x2e80 ? 16 : 5 + (codepoint % 4)
+    const height = 16
+    const data = new Uint8Array(Math.ceil((width * height) / 8)).fill(codepoint & 0xff)
+    return { width, height, data }
+  }
+}
@@ -0,0 +1,19 @@
+import { describe, expect, it } from 'vitest'
+import { GlyphDiscovery } from '../convert'
+import type { Font } from '../font'
+
+const font: Font = {
+  bpp: 1,
+  getGlyph: async () => ({ width: 1, height: 1, data: new Uint8Array(1) }),
+}
+
+describe('GlyphDiscovery', () => {
+  it('orders characters used equally often by code point, like qrconv', async () => {
+    const discovery = new GlyphDiscovery(font)
+    // 'e' twice, the others once: a locale or UTF-16 order would differ
+    await discovery.add('eeéfBaｱ\u{1f600}')
+    const { ids } = discovery.assignIDs()
+    const order = [...ids.entries()].sort((a, b) => a[1] - b[1]).map(([char]) => char)
+    expect(order).toEqual(['e', 'B', 'a', 'f', 'é', 'ｱ', '\u{1f600}'])
+  })
+})
@@ -0,0 +1,141 @@
+import { describe, expect, it } from 'vitest'
+
+// TtfFont needs a canvas, FontFace, fetch and IndexedDB. These fakes draw
+// every character as a fixed pattern of gray levels and keep the glyph cache
+// in memory, so a conversion can be repeated on a cold and a warm cache.
+
+let drawn = 0 // characters rasterized since the last check
+
+class FakeContext {
+  font = ''
+  fillStyle = ''
+  textBaseline = ''
+  private text = ''
+
+  constructor(private canvas: FakeCanvas) {}
+
+  measureText(text: string) {
+    const codepoint = text.codePointAt(0)!
+    return {
+      actualBoundingBoxLeft: 0,
+      actualBoundingBoxRight: 3 + (codepoint % 6),
+      fontBoundingBoxAscent: 12,
+      actualBoundingBoxDescent: 4,
+    }
+  }
+
+  clearRect() {}
+  fillRect() {}
+
+  fillText(text: string) {
+    this.text = text
+    drawn++
+  }
+
+  getImageData(x: number, y: number, width: number, height: number) {
+    const codepoint = this.text.codePointAt(0)!
+    const data = new Uint8ClampedArray(width * height * 4)
+    for (let i = 0; i < width * height; i++) {
+      data.fill((codepoint * 37 + i * 53) & 0xff, i * 4, i * 4 + 4)
+    }
+    return { data, width: this.canvas.width, height: this.canvas.height }
+  }
+}
+
+class FakeCanvas {
+  width = 0
+  height = 0
+  private context = new FakeContext(this)
+
+  getContext() {
+    return this.context
+  }
+}
+
+class FakeFontFace {
+  async load() {}
+}
+
+type CacheRecord = { font: string; size: number; char: string }
+
+class FakeRequest<T> {
+  result!: T
+  onsuccess: (() => void) | null = null
+  onerror: (() => void) | null = null
+  onupgradeneeded: (() => void) | null = null
+}
+
+function fakeIndexedDB() {
+  let records: CacheRecord[] | null = null
+  const store = {
+    getAll(range: { lower: [string, number] }) {
+      const request = new FakeRequest<CacheRecord[]>()
+      const [font, size] = range.lower
+      request.result = structuredClone(records!.filter((r) => r.font == font && r.size == size))
+      setTimeout(() => request.onsuccess?.())
+      return request
+    },
+    put(record: CacheRecord) {
+      records = records!.filter((r) => r.font != record.font || r.size != record.size || r.char != record.char)
+      records.push(structuredClone(record))
+    },
+  }
+  const db = {
+    createObjectStore() {
+      records = []
+    },
+    transaction() {
+      return { objectStore: () => store, onerror: null }
+    },
+  }
+  return {
+    open() {
+      const request = new FakeRequest<typeof db>()
+      request.result = db
+      setTimeout(() => {
+        if (records == null) {
+          request.onupgradeneeded?.()
+        }
+        request.onsuccess?.()
+      })
+      return request
+    },
+  }
+}
+
+Object.assign(globalThis, {
+  self: Object.assign(globalThis, { fonts: { add() {} } }),
+  OffscreenCanvas: FakeCanvas,
+  FontFace: FakeFontFace,
+  fetch: async () => new Response(new Uint8Array([1, 2, 3, 4])),
+  indexedDB: fakeIndexedDB(),
+  IDBKeyRange: { bound: (lower: unknown, upper: unknown) => ({ lower, upper }) },
+})
+
+const { TtfFont } = await import('../font')
+const { convertTextToQuickRDR } = await import('../convert')
+
+const text = 'The quick brown fox jumps over the lazy dog.\nPack my box with five dozen liquor jugs.\n'
+
+async function convert(bpp: number) {
+  const font = new TtfFont('/test.ttf', 16, undefined, bpp)
+  const { chunks } = await convertTextToQuickRDR({ text, title: 'Cache Test', font })
+  // let the cache write the new glyphs
+  await new Promise((resolve) => setTimeout(resolve))
+  return chunks
+}
+
+describe('TtfFont', () => {
+  it('converts the same 2bpp book on a cold and a warm glyph cache', async () => {
+    drawn = 0
+    const cold = await convert(2)
+    expect(drawn).toBeGreaterThan(0)
+    expect(cold[0][4]).toBe(5)
+    // 1bpp glyphs of the same font and size are cached too
+    await convert(1)
+    drawn = 0
+    const warm = await convert(2)
+    expect(drawn).toBe(0)
+    expect(warm).toEqual(cold)
+  })
+})
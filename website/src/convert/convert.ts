@@ -1,15 +1,37 @@
 import type { Font, Glyph } from "./font"
-import { partitionText } from "./partition"
+import { codeBlocks } from "./huffman"
+import { analyzeBook, type BookReport } from "./report"
 import { QuickRDRFile, QuickRDRGlyph } from "./structs"
+import { StreamEncoder } from "./stream"
 
 interface ConvertOptions {
   text: string
   title: string
   font: Font
-  lineSpacing?: number
+  coded?: boolean
 }
 
-function calcMinExtensionByte(total: number): number {
+export interface ConvertProgress {
+  stage: 'glyphs' | 'stream' | 'packing'
+  done: number // bytes of input processed in this stage
+  total: number
+}
+
+export interface ConvertResult {
+  chunks: Uint8Array[] // contents of each appvar
+  report: BookReport
+}
+
+interface StreamConvertOptions {
+  open: () => ReadableStream<Uint8Array> // UTF-8 text, opened once per pass
+  size: number
+  title: string
+  font: Font
+  coded?: boolean // Huffman-code the glyph stream, a version 6 book
+  onProgress?: (progress: ConvertProgress) => void
+}
+
+export function calcMinExtensionByte(total: number): number {
   if (total <= 255) {
     return 0;
   }
@@ -17,7 +39,7 @@ function calcMinExtensionByte(total: number): number {
   return Math.floor((65535 - total) / 255);
 }
 
-function getGlyphID(index: number, total: number): number {
+export function getGlyphID(index: number, total: number): number {
   if (index < 0) {
     throw new Error('Index must be non-negative');
   }
@@ -31,58 +53,156 @@ function getGlyphID(index: number, total: number): number {
   return (extensionByte << 8) | offset
 }
 
-export async function convertTextToQuickRDR(options: ConvertOptions): Promise<Uint8Array> {
-  const { text, title, font } = options
-  const lineSpacing = options.lineSpacing ?? 2
-  const counter = new Map<string, number>()
-  const glyphs = new Map<string, Glyph>()
-  for (const char of text) {
-    if (char == '\n') {
-      continue
-    }
-    counter.set(char, (counter.get(char) || 0) + 1)
-    if (!glyphs.has(char)) {
-      const glyph = await font.getGlyph(char)
+/**
+ * Counts the characters of a text and rasterizes each distinct one once.
+ * Newlines are not glyphs, and characters the font cannot draw are skipped.
+ */
+export class GlyphDiscovery {
+  private counts = new Map<string, number>()
+  private glyphs = new Map<string, Glyph>()
+
+  constructor(private font: Font) { }
+
+  get size(): number {
+    return this.glyphs.size
+  }
+
+  async add(text: string): Promise<void> {
+    for (const char of text) {
+      if (char == '\n' || char == '\r') {
+        continue
+      }
+      const count = this.counts.get(char)
+      if (count !== undefined) {
+        this.counts.set(char, count + 1)
+        continue
+      }
+      this.counts.set(char, 1)
+      const glyph = await this.font.getGlyph(char)
       if (glyph) {
-        glyphs.set(char, glyph)
+        this.glyphs.set(char, glyph)
       }
     }
   }
-  console.log('glyphs', glyphs)
-  const totalGlyphs = glyphs.size
-  const maxHeight = Math.max(...Array.from(glyphs.values()).map((glyph) => glyph.height))
-  const lineHeight = maxHeight + lineSpacing
-  const sortedChars = Array.from(glyphs.keys()).sort((a, b) => {
-    const aCount = counter.get(a) || 0
-    const bCount = counter.get(b) || 0
-    if (aCount === bCount) {
-      return a.localeCompare(b)
+
+  // the most frequent characters get the 1-byte IDs
+  // lineHeight is the tallest glyph, line spacing is a setting on the calculator
+  assignIDs(): { ids: Map<string, number>, glyphs: QuickRDRGlyph[], lineHeight: number } {
+    const totalGlyphs = this.glyphs.size
+    let maxHeight = 0
+    for (const glyph of this.glyphs.values()) {
+      maxHeight = Math.max(maxHeight, glyph.height)
     }
-    return bCount - aCount
-  })
-  const quickrdrGlyphs = []
-  for (let i = 0; i < sortedChars.length; i++) {
-    const char = sortedChars[i]
-    const glyph = glyphs.get(char)!
-    const id = getGlyphID(i, totalGlyphs)
-    quickrdrGlyphs.push(QuickRDRGlyph.from(id, glyph))
+    const sortedChars = Array.from(this.glyphs.keys()).sort((a, b) => {
+      const aCount = this.counts.get(a) || 0
+      const bCount = this.counts.get(b) || 0
+      if (aCount === bCount) {
+        // by code point, like compare_glyphs() in tools/qrconv/book.c
+        return a.codePointAt(0)! - b.codePointAt(0)!
+      }
+      return bCount - aCount
+    })
+    const ids = new Map<string, number>()
+    const glyphs = []
+    for (let i = 0; i < sortedChars.length; i++) {
+      const char = sortedChars[i]
+      const id = getGlyphID(i, totalGlyphs)
+      ids.set(char, id)
+      glyphs.push(QuickRDRGlyph.from(id, this.glyphs.get(char)!))
+    }
+    return { ids, glyphs, lineHeight: maxHeight }
   }
-  console.log('quickrdrGlyphs', quickrdrGlyphs)
-  const tokens = text.split('').map((char) => char == '\n' ? 0 : getGlyphID(sortedChars.indexOf(char), totalGlyphs))
-  const linesPerPage = Math.floor(180 / lineHeight)
-  const pages = partitionText({
-    text: tokens,
-    glyphs: quickrdrGlyphs,
-    linesPerPage,
-    maxWidth: 304,
+}
+
+async function* readText(
+  stream: ReadableStream<Uint8Array>,
+  onBytes: (count: number) => void,
+): AsyncGenerator<string> {
+  const counter = new TransformStream<Uint8Array, Uint8Array>({
+    transform(chunk, controller) {
+      onBytes(chunk.byteLength)
+      controller.enqueue(chunk)
+    },
   })
+  const reader = stream.pipeThrough(counter).pipeThrough(new TextDecoderStream()).getReader()
+  try {
+    while (true) {
+      const { done, value } = await reader.read()
+      if (done) {
+        return
+      }
+      yield value
+    }
+  } finally {
+    reader.releaseLock()
+  }
+}
+
+/**
+ * Converts a text in two streaming passes: the first counts characters and
+ * rasterizes glyphs, the second assigns glyph IDs and encodes the glyph
+ * stream, which the calculator paginates for its own margins and line
+ * spacing. Only the glyphs and the encoded stream are kept in memory.
+ */
+export async function convertStreamToQuickRDR(options: StreamConvertOptions): Promise<ConvertResult> {
+  const { open, size, title, font, coded, onProgress } = options
+
+  let done = 0
+  const discovery = new GlyphDiscovery(font)
+  for await (const chunk of readText(open(), (count) => (done += count))) {
+    await discovery.add(chunk)
+    onProgress?.({ stage: 'glyphs', done, total: size })
+  }
+  if (discovery.size == 0) {
+    throw new Error('The text has no printable characters')
+  }
+  const { ids, glyphs: quickrdrGlyphs, lineHeight } = discovery.assignIDs()
+
+  const encoder = new StreamEncoder()
+  done = 0
+  for await (const chunk of readText(open(), (count) => (done += count))) {
+    for (const char of chunk) {
+      if (char == '\n') {
+        encoder.push(0)
+        continue
+      }
+      const id = ids.get(char)
+      if (id !== undefined) {
+        // characters without a glyph (and '\r') are dropped
+        encoder.push(id)
+      }
+    }
+    onProgress?.({ stage: 'stream', done, total: size })
+  }
+  const minExtensionByte = calcMinExtensionByte(quickrdrGlyphs.length)
+  let blocks = encoder.finish()
+  let code = null
+  if (coded) {
+    ({ code, blocks } = codeBlocks(blocks, minExtensionByte))
+  }
+
+  onProgress?.({ stage: 'packing', done: 0, total: size })
   const file = new QuickRDRFile(
-    1,
+    code ? 6 : font.bpp == 2 ? 5 : 4,
     title,
-    calcMinExtensionByte(quickrdrGlyphs.length),
+    minExtensionByte,
     lineHeight,
     quickrdrGlyphs,
-    pages
+    blocks,
+    code,
+    font.bpp,
   )
-  return file.asBuffer()
+  const chunks = file.asChunks()
+  const report = analyzeBook(file)
+  onProgress?.({ stage: 'packing', done: size, total: size })
+  return { chunks, report }
+}
+
+export async function convertTextToQuickRDR(options: ConvertOptions): Promise<ConvertResult> {
+  const blob = new Blob([options.text])
+  return convertStreamToQuickRDR({
+    ...options,
+    open: () => blob.stream(),
+    size: blob.size,
+  })
 }
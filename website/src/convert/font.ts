@@ -1,46 +1,78 @@
 import { setBit } from "@/utils"
+import { GlyphCache, hashFont } from "./glyphCache"
 
 export declare interface Font {
+  readonly bpp: number // 1, or 2 for anti-aliased glyphs (version 5 books)
   getGlyph(text: string): Promise<Glyph | null>
 }
 
 export declare interface Glyph {
   width: number
   height: number
-  data: Uint8Array // 1 bit per pixel
+  // 1 bit per pixel, or 2 bits per pixel with each row padded to a byte
+  data: Uint8Array
 }
 
 export class TtfFont implements Font {
   public family: string
-  private font: FontFace
   private glyphs: Map<string, Glyph | null>
   private canvas: OffscreenCanvas | HTMLCanvasElement
+  private cache: GlyphCache | null = null
+  private fontHash = ''
   public fontLoaded: Promise<any>
 
-  constructor(fontUrl: any, private fontSize: number, canvas?: OffscreenCanvas | HTMLCanvasElement) {
+  constructor(
+    fontUrl: any,
+    private fontSize: number,
+    canvas?: OffscreenCanvas | HTMLCanvasElement,
+    public readonly bpp = 1,
+  ) {
     this.family = Math.random().toString(36).substring(2, 15)
-    this.font = new FontFace(this.family, `url(${fontUrl})`, {
+    this.glyphs = new Map()
+    this.canvas = canvas || new OffscreenCanvas(0, 0)
+    this.fontLoaded = this.load(fontUrl)
+  }
+
+  private async load(fontUrl: any): Promise<void> {
+    const response = await fetch(fontUrl)
+    const data = await response.arrayBuffer()
+    const font = new FontFace(this.family, data, {
       style: 'normal',
       weight: 'normal',
       stretch: 'normal',
     })
-    this.glyphs = new Map()
-    this.canvas = canvas || new OffscreenCanvas(0, 0)
-    document.fonts.add(this.font)
-    this.fontLoaded = this.font.load()
+    // the converter also runs in a worker, which has its own font set
+    const fonts = typeof document !== 'undefined' ? document.fonts : (self as unknown as { fonts: FontFaceSet }).fonts
+    fonts.add(font)
+    const [hash, cache] = await Promise.all([
+      crypto.subtle ? hashFont(data) : Promise.resolve(''),
+      GlyphCache.open(),
+      font.load(),
+    ])
+    if (hash && cache) {
+      // 2bpp glyphs of the same font are cached separately
+      this.fontHash = this.bpp == 2 ? hash + ':2bpp' : hash
+      this.cache = cache
+      try {
+        for (const [char, glyph] of await cache.loadAll(this.fontHash, this.fontSize)) {
+          this.glyphs.set(char, glyph)
+        }
+      } catch (e) {
+        console.warn('Failed to load cached glyphs', e)
+      }
+    }
   }
 
   async getGlyph(text: string): Promise<Glyph | null> {
+    await this.fontLoaded
     if (this.glyphs.has(text)) {
       return this.glyphs.get(text) || null
     }
-    await this.fontLoaded
     const ctx = this.canvas.getContext('2d') as OffscreenCanvasRenderingContext2D | CanvasRenderingContext2D
     if (!ctx) {
       throw new Error('Failed to get 2D context')
     }
     ctx.font = `${this.fontSize}px ${this.family}`
-    console.log('font', ctx.font)
     const metrics = ctx.measureText(text)
     const width = Math.ceil(metrics.actualBoundingBoxRight + metrics.actualBoundingBoxLeft)
     const height = Math.ceil(metrics.fontBoundingBoxAscent + metrics.actualBoundingBoxDescent)
@@ -54,33 +86,44 @@ export class TtfFont implements Font {
     ctx.font = `${this.fontSize}px ${this.family}`
     ctx.fillText(text, 0, 0)
     const imageData = ctx.getImageData(0, 0, width, height)
-    const data = new Uint8Array(Math.ceil(width * height / 8))
-    for (let y = 0; y < height; y++) {
-      for (let x = 0; x < width; x++) {
-        const bitIndex = y * width + x
-        const isBlack = imageData.data[(y * width + x) * 4] < 128
-        setBit(data, bitIndex, isBlack)
-      }
-    }
-    // TODO delete me
-    const debugCanvas = document.createElement('canvas')
-    const debugCtx = debugCanvas.getContext('2d')
-    if (!debugCtx) {
-      throw new Error('Failed to get 2D context')
-    }
-    debugCanvas.width = width
-    debugCanvas.height = height
-    debugCtx.putImageData(imageData, 0, 0)
-    document.body.appendChild(debugCanvas)
+    const data = this.bpp == 2 ? grayPixels(imageData, width, height) : monoPixels(imageData, width, height)
     const glyph: Glyph = {
       width,
       height,
       data,
     }
     this.glyphs.set(text, glyph)
+    this.cache?.put(this.fontHash, this.fontSize, text, glyph)
     return glyph
   }
 }
 
+function monoPixels(imageData: ImageData, width: number, height: number): Uint8Array {
+  const data = new Uint8Array(Math.ceil(width * height / 8))
+  for (let y = 0; y < height; y++) {
+    for (let x = 0; x < width; x++) {
+      const bitIndex = y * width + x
+      const isBlack = imageData.data[(y * width + x) * 4] < 128
+      setBit(data, bitIndex, isBlack)
+    }
+  }
+  return data
+}
+
+// 4 levels from white (0) to black (3), first pixel in the top bits
+function grayPixels(imageData: ImageData, width: number, height: number): Uint8Array {
+  const rowBytes = Math.ceil(width / 4)
+  const data = new Uint8Array(rowBytes * height)
+  for (let y = 0; y < height; y++) {
+    for (let x = 0; x < width; x++) {
+      const ink = 255 - imageData.data[(y * width + x) * 4]
+      const level = Math.floor((ink * 3 + 127) / 255)
+      data[y * rowBytes + (x >> 2)] |= level << (6 - 2 * (x & 3))
+    }
+  }
+  return data
+}
+
 export const font = new TtfFont('/unifont.otf', 16)
+export const grayFont = new TtfFont('/unifont.otf', 16, undefined, 2)
 // export const font = new TtfFont('/font.ttf', 16)
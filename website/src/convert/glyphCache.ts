@@ -0,0 +1,78 @@
+import type { Glyph } from "./font"
+
+const DB_NAME = 'quickrdr-glyphs'
+const STORE_NAME = 'glyphs'
+
+interface GlyphRecord extends Glyph {
+  font: string // SHA-256 of the font file
+  size: number
+  char: string
+}
+
+function promisify<T>(request: IDBRequest<T>): Promise<T> {
+  return new Promise((resolve, reject) => {
+    request.onsuccess = () => resolve(request.result)
+    request.onerror = () => reject(request.error)
+  })
+}
+
+/**
+ * Rasterized glyphs persisted in IndexedDB, keyed by font hash, font size and
+ * character, so repeat conversions skip the canvas work for known glyphs.
+ */
+export class GlyphCache {
+  private pending: GlyphRecord[] = []
+  private flushScheduled = false
+
+  private constructor(private db: IDBDatabase) { }
+
+  static async open(): Promise<GlyphCache | null> {
+    if (typeof indexedDB === 'undefined') {
+      return null
+    }
+    const request = indexedDB.open(DB_NAME, 1)
+    request.onupgradeneeded = () => {
+      request.result.createObjectStore(STORE_NAME, { keyPath: ['font', 'size', 'char'] })
+    }
+    try {
+      return new GlyphCache(await promisify(request))
+    } catch (e) {
+      console.warn('Glyph cache unavailable', e)
+      return null
+    }
+  }
+
+  async loadAll(font: string, size: number): Promise<Map<string, Glyph>> {
+    const store = this.db.transaction(STORE_NAME, 'readonly').objectStore(STORE_NAME)
+    // arrays sort after strings, so this range covers every character
+    const range = IDBKeyRange.bound([font, size], [font, size, []])
+    const records = (await promisify(store.getAll(range))) as GlyphRecord[]
+    return new Map(records.map(({ char, width, height, data }) => [char, { width, height, data }]))
+  }
+
+  put(font: string, size: number, char: string, glyph: Glyph): void {
+    this.pending.push({ font, size, char, ...glyph })
+    if (!this.flushScheduled) {
+      // new glyphs are written in one transaction per batch
+      this.flushScheduled = true
+      setTimeout(() => this.flush(), 0)
+    }
+  }
+
+  private flush(): void {
+    this.flushScheduled = false
+    const records = this.pending
+    this.pending = []
+    const transaction = this.db.transaction(STORE_NAME, 'readwrite')
+    const store = transaction.objectStore(STORE_NAME)
+    for (const record of records) {
+      store.put(record)
+    }
+    transaction.onerror = () => console.warn('Failed to cache glyphs', transaction.error)
+  }
+}
+
+export async function hashFont(data: ArrayBuffer): Promise<string> {
+  const digest = await crypto.subtle.digest('SHA-256', data)
+  return Array.from(new Uint8Array(digest), (byte) => byte.toString(16).padStart(2, '0')).join('')
+}
@@ -0,0 +1,202 @@
+// largest code of a version 6 book, QUICKRDR_MAX_CODE_LENGTH on the calculator
+export const MAX_CODE_LENGTH = 16
+// blocks of a version 6 book, QUICKRDR_MAX_CODED_BLOCKS on the calculator
+export const MAX_CODED_BLOCKS = 0x3fff
+
+/**
+ * Canonical Huffman code over glyph IDs, see quickrdr_code_t in src/quickrdr.h.
+ */
+export interface HuffmanCode {
+  symbols: number[] // glyph IDs in the order of their codes
+  lengthCounts: number[] // codes of 1 to MAX_CODE_LENGTH bits
+  lengths: Map<number, number> // by glyph ID
+  codes: Map<number, number>
+}
+
+interface Leaf {
+  weight: number
+  id: number
+  length: number
+}
+
+// codes per length of a Huffman tree, built with two queues: the leaves from
+// rarest to commonest and the inner nodes in the order they are made, a leaf
+// going first on equal weights
+function treeLengths(leaves: Leaf[]): number[] {
+  const bits = new Array<number>(64).fill(0)
+  const count = leaves.length
+  if (count == 1) {
+    bits[1] = 1
+    return bits
+  }
+  const nodes = 2 * count - 1
+  const weight = new Float64Array(nodes)
+  const parent = new Int32Array(nodes)
+  const depth = new Int32Array(nodes)
+  leaves.forEach((leaf, i) => (weight[i] = leaf.weight))
+  let nextLeaf = 0
+  let nextInner = count
+  for (let made = count; made < nodes; made++) {
+    for (let pick = 0; pick < 2; pick++) {
+      let node
+      if (nextLeaf < count && (nextInner == made || weight[nextLeaf] <= weight[nextInner])) {
+        node = nextLeaf++
+      } else {
+        node = nextInner++
+      }
+      parent[node] = made
+      weight[made] += weight[node]
+    }
+  }
+  for (let i = nodes - 2; i >= 0; i--) {
+    depth[i] = depth[parent[i]] + 1
+  }
+  for (let i = 0; i < count; i++) {
+    bits[Math.min(depth[i], 63)]++
+  }
+  return bits
+}
+
+/**
+ * Builds the code for glyph IDs that occur `counts.get(id)` times, the same
+ * code as qrconv_code_build() in tools/qrconv/huffman.c.
+ */
+export function buildCode(counts: Map<number, number>): HuffmanCode {
+  const leaves: Leaf[] = []
+  for (const [id, weight] of counts) {
+    if (weight > 0) {
+      leaves.push({ weight, id, length: 0 })
+    }
+  }
+  const code: HuffmanCode = {
+    symbols: [],
+    lengthCounts: new Array<number>(MAX_CODE_LENGTH).fill(0),
+    lengths: new Map(),
+    codes: new Map(),
+  }
+  if (leaves.length == 0) {
+    return code
+  }
+  leaves.sort((a, b) => a.weight - b.weight || a.id - b.id)
+  const bits = treeLengths(leaves)
+  // limit the codes to MAX_CODE_LENGTH bits, like JPEG (ITU T.81 K.3)
+  for (let i = bits.length - 1; i > MAX_CODE_LENGTH; i--) {
+    while (bits[i] > 0) {
+      let j = i - 2
+      while (bits[j] == 0) {
+        j--
+      }
+      bits[i] -= 2
+      bits[i - 1]++
+      bits[j + 1] += 2
+      bits[j]--
+    }
+  }
+  // the shortest codes go to the commonest glyphs
+  leaves.sort((a, b) => b.weight - a.weight || a.id - b.id)
+  let next = 0
+  for (let length = 1; length <= MAX_CODE_LENGTH; length++) {
+    code.lengthCounts[length - 1] = bits[length]
+    for (let i = 0; i < bits[length]; i++) {
+      leaves[next++].length = length
+    }
+  }
+  leaves.sort((a, b) => a.length - b.length || a.id - b.id)
+  let value = 0
+  let length = leaves[0].length
+  for (const leaf of leaves) {
+    value *= 2 ** (leaf.length - length)
+    length = leaf.length
+    code.symbols.push(leaf.id)
+    code.lengths.set(leaf.id, length)
+    code.codes.set(leaf.id, value++)
+  }
+  return code
+}
+
+/**
+ * A block of a version 6 stream: the number of glyph IDs and their codes,
+ * first bit in the top bit of a byte.
+ */
+export function codeBlock(code: HuffmanCode, ids: number[]): Uint8Array {
+  const out = [ids.length & 0xff, ids.length >> 8]
+  let pending = 0 // bits not written yet, in the low `used` bits
+  let used = 0
+  for (const id of ids) {
+    const length = code.lengths.get(id)!
+    pending = ((pending << length) | code.codes.get(id)!) & 0xffffff
+    used += length
+    while (used >= 8) {
+      used -= 8
+      out.push((pending >> used) & 0xff)
+    }
+  }
+  if (used > 0) {
+    out.push((pending << (8 - used)) & 0xff)
+  }
+  return new Uint8Array(out)
+}
+
+/**
+ * Decodes a block of a version 6 stream, like qrconv_decode_block().
+ */
+export function decodeBlock(code: HuffmanCode, block: Uint8Array): number[] {
+  const count = block[0] | (block[1] << 8)
+  const ids = []
+  let bit = 16
+  for (let i = 0; i < count; i++) {
+    // canonical codes of each length follow the last code of the one before
+    let value = 0
+    let first = 0
+    let symbol = 0
+    let length = 1
+    for (; length <= MAX_CODE_LENGTH; length++) {
+      if (bit >= 8 * block.length) {
+        throw new Error('Block ends in the middle of a code')
+      }
+      value = value * 2 + ((block[bit >> 3] >> (7 - (bit & 7))) & 1)
+      bit++
+      if (value - first >= 0 && value - first < code.lengthCounts[length - 1]) {
+        ids.push(code.symbols[symbol + value - first])
+        break
+      }
+      symbol += code.lengthCounts[length - 1]
+      first = (first + code.lengthCounts[length - 1]) * 2
+    }
+    if (length > MAX_CODE_LENGTH) {
+      throw new Error('Invalid code')
+    }
+  }
+  return ids
+}
+
+// the glyph IDs of a block of 1- and 2-byte IDs
+export function blockIDs(block: Uint8Array, minExtensionByte: number): number[] {
+  const ids = []
+  for (let i = 0; i < block.length; i++) {
+    let id = block[i]
+    if (minExtensionByte != 0 && id >= minExtensionByte) {
+      id = (id << 8) | block[++i]
+    }
+    ids.push(id)
+  }
+  return ids
+}
+
+/**
+ * Codes the blocks of a version 4 stream for a version 6 book, keeping the
+ * cuts between blocks. Same as code_stream() in tools/qrconv/book.c.
+ */
+export function codeBlocks(blocks: Uint8Array[], minExtensionByte: number): { code: HuffmanCode, blocks: Uint8Array[] } {
+  if (blocks.length > MAX_CODED_BLOCKS) {
+    throw new Error('The text is too long to compress, it has ' + blocks.length + ' blocks')
+  }
+  const counts = new Map<number, number>()
+  for (const block of blocks) {
+    for (const id of blockIDs(block, minExtensionByte)) {
+      counts.set(id, (counts.get(id) ?? 0) + 1)
+    }
+  }
+  const code = buildCode(counts)
+  return { code, blocks: blocks.map((block) => codeBlock(code, blockIDs(block, minExtensionByte))) }
+}
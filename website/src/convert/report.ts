@@ -0,0 +1,190 @@
+import { blockIDs, decodeBlock } from "./huffman"
+import type { QuickRDRFile } from "./structs"
+import { MAX_APPVAR_SIZE } from "./ti"
+
+// default settings of the reader, see settings_choice in src/main.c
+const READER_MARGIN = 8
+const READER_LINE_SPACING = 2
+// text area of the reader, see src/textmode.h
+const TEXT_WIDTH = 320
+const TEXT_HEIGHT = 196
+
+interface PageCost {
+  mean: number
+  max: number
+}
+
+/**
+ * Where the bytes of a book go and what its pages cost the calculator. The
+ * sections add up to the total size; mirrors the report of tools/qrconv.
+ */
+export interface BookReport {
+  title: string
+  version: number
+  appVars: number
+  totalBytes: number
+  sections: {
+    header: number // header, layout, chunk sizes and hashes
+    pageTable: number // address of each block of the stream
+    glyphs: number // glyph records without padding
+    glyphPadding: number // every glyph is padded to font_glyph_size
+    oneByteRefs: number
+    twoByteRefs: number
+    paragraphBreaks: number
+    symbolTable: number // glyph IDs by code, version 6
+    codedText: number // the blocks of a version 6 book, instead of the refs
+  }
+  // the text with 1- and 2-byte glyph IDs, to compare with codedText
+  byteCodedText: number
+  glyphCount: number
+  glyphSize: number
+  // unused bytes at the end of appvars that are followed by another one
+  appVarSlack: number
+  // pages laid out like reflow_page() in src/reflow.c with the default settings
+  pages: {
+    margin: number
+    lineSpacing: number
+    lines: number
+    count: number
+    glyphLookups: PageCost // glyphs drawn
+    bytesCopied: PageCost // glyph IDs copied out of the archive
+    chunkCrossings: PageCost // moves of the stream cursor into another appvar
+  }
+}
+
+function cost(values: number[]): PageCost {
+  let sum = 0
+  let max = 0
+  for (const value of values) {
+    sum += value
+    max = Math.max(max, value)
+  }
+  return { mean: values.length ? Math.round((sum / values.length) * 10) / 10 : 0, max }
+}
+
+export function analyzeBook(file: QuickRDRFile): BookReport {
+  const { chunkSizes, pageAddresses } = file.layout()
+  const glyphSize = file.glyphSize
+  const minExtensionByte = file.min_extension_byte
+  const widths = new Map<number, number>()
+  let glyphBytes = 0
+  for (const glyph of file.glyphs) {
+    widths.set(glyph.id, glyph.width)
+    glyphBytes += 4 + glyph.data.length
+  }
+
+  // the stream as glyph IDs, with the appvar each one is stored in
+  const blocks = file.pages.map((page) => (file.code ? decodeBlock(file.code, page) : blockIDs(page, minExtensionByte)))
+  let streamLength = 0
+  for (const block of blocks) {
+    streamLength += block.length
+  }
+  const ids = new Uint16Array(streamLength)
+  const chunkOf = new Uint8Array(streamLength)
+  let count = 0
+  let oneByteRefs = 0
+  let twoByteRefs = 0
+  let paragraphBreaks = 0
+  blocks.forEach((block, i) => {
+    const chunk = pageAddresses[i] >> 16
+    for (const id of block) {
+      if (id > 0xff) {
+        twoByteRefs++
+      } else if (id == 0) {
+        paragraphBreaks++
+      } else {
+        oneByteRefs++
+      }
+      chunkOf[count] = chunk
+      ids[count++] = id
+    }
+  })
+  const byteCodedText = oneByteRefs + 2 * twoByteRefs + paragraphBreaks
+  let codedText = 0
+  if (file.code) {
+    for (const page of file.pages) {
+      codedText += page.length
+    }
+    oneByteRefs = twoByteRefs = paragraphBreaks = 0
+  }
+
+  const width = TEXT_WIDTH - 2 * READER_MARGIN
+  const lineHeight = file.line_height + READER_LINE_SPACING
+  const lines = Math.max(1, Math.floor((TEXT_HEIGHT - 2 * READER_MARGIN) / (lineHeight || 1)))
+  const lookups: number[] = []
+  const copied: number[] = []
+  const crossings: number[] = []
+  let position = 0
+  while (position < count) {
+    let pageLines = 0
+    let pageLookups = 0
+    let pageBytes = 0
+    let pageCrossings = 0
+    const start = position
+    while (position < count && pageLines < lines) {
+      let lineWidth = 0
+      let open = false
+      while (position < count) {
+        const id = ids[position]
+        const glyphWidth = id ? (widths.get(id) ?? 0) : 0
+        if (id && open && lineWidth + glyphWidth > width) {
+          break
+        }
+        if (!open) {
+          if (pageLines) {
+            pageBytes++
+          }
+          open = true
+        }
+        if (position > start && chunkOf[position] != chunkOf[position - 1]) {
+          pageCrossings++
+        }
+        position++
+        if (id == 0) {
+          break
+        }
+        pageBytes += id > 0xFF ? 2 : 1
+        pageLookups++
+        lineWidth += glyphWidth
+      }
+      if (open) {
+        pageLines++
+      }
+    }
+    lookups.push(pageLookups)
+    copied.push(pageBytes)
+    crossings.push(pageCrossings)
+  }
+
+  const totalBytes = chunkSizes.reduce((acc, size) => acc + size, 0)
+  return {
+    title: file.name,
+    version: file.version,
+    appVars: chunkSizes.length,
+    totalBytes,
+    sections: {
+      header: 34 + 7 + 6 * chunkSizes.length + (file.code ? 36 : 0),
+      pageTable: 3 * file.pages.length,
+      glyphs: glyphBytes,
+      glyphPadding: glyphSize * file.glyphs.length - glyphBytes,
+      oneByteRefs,
+      twoByteRefs: 2 * twoByteRefs,
+      paragraphBreaks,
+      symbolTable: 2 * (file.code?.symbols.length ?? 0),
+      codedText,
+    },
+    byteCodedText,
+    glyphCount: file.glyphs.length,
+    glyphSize,
+    appVarSlack: chunkSizes.slice(0, -1).reduce((acc, size) => acc + MAX_APPVAR_SIZE - size, 0),
+    pages: {
+      margin: READER_MARGIN,
+      lineSpacing: READER_LINE_SPACING,
+      lines,
+      count: lookups.length,
+      glyphLookups: cost(lookups),
+      bytesCopied: cost(copied),
+      chunkCrossings: cost(crossings),
+    },
+  }
+}
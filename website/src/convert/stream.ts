@@ -0,0 +1,70 @@
+// largest block of the glyph stream, QUICKRDR_BLOCK_SIZE on the calculator
+export const BLOCK_SIZE = 1024
+// blocks are only cut by content once they are this long
+const BLOCK_MIN_SIZE = 256
+// top 9 bits of the gear hash, about 512 bytes between content cuts
+const BLOCK_CUT_MASK = 0xff800000
+
+// gear hash of one byte, mirrors gear() in tools/qrconv/book.c
+function gear(byte: number): number {
+  return Math.imul(byte + 1, 0x9e3779b1)
+}
+
+/**
+ * Encodes glyph IDs (0 for a paragraph break) into the blocks of a version 4
+ * book. The calculator lays out pages itself, so the stream only has to be
+ * cut into blocks, never in the middle of a 2-byte glyph ID. Blocks are cut
+ * where a gear hash of the last few bytes matches a pattern, so the same
+ * text gives the same blocks wherever it is in the book and an edit only
+ * changes the blocks around it.
+ */
+export class StreamEncoder {
+  private blocks: Uint8Array[] = []
+  private block = new Uint8Array(BLOCK_SIZE)
+  private length = 0
+  private hash = 0
+
+  get blockCount(): number {
+    return this.blocks.length
+  }
+
+  push(glyphId: number): void {
+    const size = glyphId > 0xFF ? 2 : 1
+    if (this.length + size > BLOCK_SIZE) {
+      this.endBlock()
+    }
+    if (size == 2) {
+      this.put((glyphId >> 8) & 0xFF)
+    }
+    this.put(glyphId & 0xFF)
+    if (this.length >= BLOCK_MIN_SIZE && (this.hash & BLOCK_CUT_MASK) == 0) {
+      this.endBlock()
+    }
+  }
+
+  finish(): Uint8Array[] {
+    if (this.length > 0) {
+      this.endBlock()
+    }
+    return this.blocks
+  }
+
+  private put(byte: number): void {
+    this.block[this.length++] = byte
+    this.hash = ((this.hash << 1) + gear(byte)) | 0
+  }
+
+  private endBlock(): void {
+    this.blocks.push(this.block.slice(0, this.length))
+    this.length = 0
+    this.hash = 0
+  }
+}
+
+export function encodeStream(text: number[]): Uint8Array[] {
+  const encoder = new StreamEncoder()
+  for (const glyphId of text) {
+    encoder.push(glyphId)
+  }
+  return encoder.finish()
+}
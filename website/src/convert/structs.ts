@@ -1,4 +1,15 @@
 import type { Glyph } from "./font"
+import { MAX_CODE_LENGTH, type HuffmanCode } from "./huffman"
+import { fnv1a, MAX_APPVAR_SIZE } from "./ti"
+
+const MAX_CHUNKS = 100
+// Once a stream chunk holds CHUNK_MIN_SIZE bytes, it ends after a block whose
+// hash has this many low zero bits, about one in 8 blocks, or else when the
+// next block does not fit. Books that would need too many appvars fall back
+// to filling every appvar (-1).
+const CHUNK_CUT_LEVELS = [3, -1]
+// so that content cuts do not leave appvars mostly empty
+const CHUNK_MIN_SIZE = 48 * 1024
 
 export class QuickRDRFile {
   constructor(
@@ -7,65 +18,184 @@ export class QuickRDRFile {
     public min_extension_byte: number,
     public line_height: number,
     public glyphs: QuickRDRGlyph[],
-    public pages: Uint8Array[]
+    public pages: Uint8Array[], // blocks of the glyph stream
+    public code: HuffmanCode | null = null, // that the blocks are coded with, version 6
+    public glyphBpp = 1, // of a version 6 book
   ) { }
 
-  asBuffer(): Uint8Array {
+  // Lays out a version 4 or later book: records never straddle two appvars,
+  // a record that does not fit in the rest of a chunk starts the next one.
+  // The glyph table and the stream start appvars of their own, and the stream
+  // is split into appvars after blocks picked by their hash. Blocks are cut by
+  // content too, so the unchanged parts of a revised book give the same
+  // appvars. Returns the contents of each appvar.
+  asChunks(): Uint8Array[] {
     const magic = 0x51524452 // 'QRDR'
     const font_glyph_count = this.glyphs.length
-    const font_glyph_size = Math.max(...this.glyphs.map((glyph) => glyph.data.length)) + 4
+    const font_glyph_size = this.glyphSize
     const page_count = this.pages.length
-    const total_size = 34 + 3 * page_count + font_glyph_count * font_glyph_size + this.pages.reduce((acc, page) => acc + page.length, 0)
-    const buffer = new Uint8Array(total_size)
-    const dataView = new DataView(buffer.buffer)
+    const { chunkSizes, pageTable, symbolTable, glyphTable, pageAddresses } = this.layout()
+    const chunks = chunkSizes.map((size) => new Uint8Array(size))
+    const total_size = chunkSizes.reduce((acc, size) => acc + size, 0)
+
+    const header = chunks[0]
+    const dataView = new DataView(header.buffer)
     dataView.setUint32(0, magic)
-    buffer[4] = this.version
+    header[4] = this.version
     for (let i = 0; i < 15; i++) {
       if (i < this.name.length) {
-        buffer[5 + i] = this.name.charCodeAt(i)
+        header[5 + i] = this.name.charCodeAt(i)
       } else {
-        buffer[5 + i] = 0
+        header[5 + i] = 0
       }
     }
-    buffer[20] = 0
-    dataView.setUint32(21, total_size, true)
-    buffer[24] = this.min_extension_byte
-    buffer[25] = this.line_height
-    dataView.setUint32(26, font_glyph_count, true)
+    header[20] = 0
+    setUint24(dataView, 21, total_size)
+    header[24] = this.min_extension_byte
+    header[25] = this.line_height
+    setUint24(dataView, 26, font_glyph_count)
     dataView.setUint16(29, font_glyph_size, true)
-    dataView.setUint32(31, page_count, true)
-    let offset = 34
-    let pageOffset = 34 + 3 * page_count + font_glyph_count * font_glyph_size
+    setUint24(dataView, 31, page_count)
+    header[34] = chunkSizes.length
+    setUint24(dataView, 35, pageTable[0])
+    setUint24(dataView, 38, glyphTable[0])
+    for (let i = 0; i < chunkSizes.length; i++) {
+      dataView.setUint16(41 + 2 * i, chunkSizes[i], true)
+    }
+
+    if (this.code) {
+      // quickrdr_code_t follows the chunk hashes
+      const code = 41 + 6 * chunkSizes.length
+      header[code] = this.glyphBpp
+      setUint24(dataView, code + 1, symbolTable[0])
+      for (let i = 0; i < MAX_CODE_LENGTH; i++) {
+        dataView.setUint16(code + 4 + 2 * i, this.code.lengthCounts[i], true)
+      }
+      this.code.symbols.forEach((id, i) => {
+        const [chunk, offset] = splitAddress(symbolTable[i])
+        new DataView(chunks[chunk].buffer).setUint16(offset, id, true)
+      })
+    }
     for (let i = 0; i < page_count; i++) {
-      dataView.setUint32(offset, pageOffset, true)
-      offset += 3
-      pageOffset += this.pages[i].length
+      const [chunk, offset] = splitAddress(pageTable[i])
+      setUint24(new DataView(chunks[chunk].buffer), offset, pageAddresses[i])
     }
     for (let i = 0; i < font_glyph_count; i++) {
-      console.log('glyph', this.glyphs[i], 'data length', this.glyphs[i].data.length, 'font_glyph_size', font_glyph_size)
       const glyph = this.glyphs[i]
-      dataView.setUint16(offset, glyph.id, true)
+      const [chunk, offset] = splitAddress(glyphTable[i])
+      const buffer = chunks[chunk]
+      new DataView(buffer.buffer).setUint16(offset, glyph.id, true)
       buffer[offset + 2] = glyph.width
       buffer[offset + 3] = glyph.height
-      for (let j = 0; j < glyph.data.length; j++) {
-        buffer[offset + 4 + j] = glyph.data[j]
-      }
-      for (let j = glyph.data.length; j < font_glyph_size - 4; j++) {
-        buffer[offset + 4 + j] = 0
-      }
-      offset += font_glyph_size
+      buffer.set(glyph.data, offset + 4)
     }
     for (let i = 0; i < page_count; i++) {
-      const page = this.pages[i]
-      for (let j = 0; j < page.length; j++) {
-        buffer[offset + j] = page[j]
+      const [chunk, offset] = splitAddress(pageAddresses[i])
+      chunks[chunk].set(this.pages[i], offset)
+    }
+    // the calculator finds the other appvars by these hashes (see chunkName())
+    const hashes = 41 + 2 * chunkSizes.length
+    for (let i = 1; i < chunks.length; i++) {
+      dataView.setUint32(hashes + 4 * i, fnv1a(chunks[i]), true)
+    }
+    return chunks
+  }
+
+  get glyphSize(): number {
+    return this.glyphs.reduce((acc, glyph) => Math.max(acc, glyph.data.length), 0) + 4
+  }
+
+  // where asChunks() puts each record
+  layout(): BookLayout {
+    const pageHashes = this.pages.map(fnv1a)
+    let layout
+    for (const level of CHUNK_CUT_LEVELS) {
+      // the header grows with the number of chunks, so repeat until it is stable
+      const lay = (chunkCount: number) =>
+        layoutChunks(chunkCount, this.pages.length, this.code?.symbols.length ?? 0, this.glyphs.length, this.glyphSize,
+          this.pages, pageHashes, level)
+      layout = lay(1)
+      while (layout.chunkSizes.length != layout.chunkCount) {
+        layout = lay(layout.chunkSizes.length)
+      }
+      if (layout.chunkSizes.length <= MAX_CHUNKS) {
+        break
       }
-      offset += page.length
     }
-    return buffer
+    if (layout!.chunkSizes.length > MAX_CHUNKS) {
+      throw new Error('Book is too large, it needs ' + layout!.chunkSizes.length + ' appvars')
+    }
+    return layout!
   }
 }
 
+export interface BookLayout {
+  chunkSizes: number[]
+  pageTable: number[] // address of each record, (chunk << 16) | offset
+  symbolTable: number[] // version 6
+  glyphTable: number[]
+  pageAddresses: number[]
+}
+
+function setUint24(dataView: DataView, offset: number, value: number) {
+  dataView.setUint16(offset, value & 0xffff, true)
+  dataView.setUint8(offset + 2, value >> 16)
+}
+
+function splitAddress(address: number): [number, number] {
+  return [address >> 16, address & 0xffff]
+}
+
+function layoutChunks(
+  chunkCount: number,
+  pageCount: number,
+  symbolCount: number,
+  glyphCount: number,
+  glyphSize: number,
+  pages: Uint8Array[],
+  pageHashes: number[],
+  level: number,
+): BookLayout & { chunkCount: number } {
+  // header, layout, chunk sizes and chunk hashes, and the code of a version 6 book
+  const chunkSizes = [34 + 7 + 6 * chunkCount + (symbolCount ? 36 : 0)]
+  const place = (size: number) => {
+    if (size > MAX_APPVAR_SIZE) {
+      throw new Error('A page does not fit in one appvar')
+    }
+    if (chunkSizes[chunkSizes.length - 1] + size > MAX_APPVAR_SIZE) {
+      chunkSizes.push(0)
+    }
+    const chunk = chunkSizes.length - 1
+    const address = (chunk << 16) | chunkSizes[chunk]
+    chunkSizes[chunk] += size
+    return address
+  }
+  const newChunk = () => {
+    if (chunkSizes[chunkSizes.length - 1] > 0) {
+      chunkSizes.push(0)
+    }
+  }
+  const mask = (1 << level) - 1
+  const pageTable = Array.from({ length: pageCount }, () => place(3))
+  const symbolTable = Array.from({ length: symbolCount }, () => place(2))
+  newChunk()
+  const glyphTable = Array.from({ length: glyphCount }, () => place(glyphSize))
+  newChunk()
+  const pageAddresses = pages.map((page, i) => {
+    const address = place(page.length)
+    const filled = chunkSizes[chunkSizes.length - 1] >= CHUNK_MIN_SIZE
+    if (level >= 0 && i + 1 < pages.length && filled && (pageHashes[i] & mask) == 0) {
+      newChunk()
+    }
+    return address
+  })
+  // an empty table still needs an address
+  if (pageCount == 0) pageTable.push(0)
+  if (glyphCount == 0) glyphTable.push(0)
+  if (symbolCount == 0) symbolTable.push(0)
+  return { chunkCount, chunkSizes, pageTable, symbolTable, glyphTable, pageAddresses }
+}
+
 export class QuickRDRGlyph {
   constructor(
     public id: number,
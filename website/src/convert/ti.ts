@@ -1,16 +1,70 @@
 export const MAX_APPVAR_SIZE = 65460
 
-export function convertDataToAppVars(data: Uint8Array, name: string): Uint8Array[] {
-  if (name.length > 6) {
+const NAME_ALPHABET = 'ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789'
+
+export interface AppVar {
+  name: string
+  hash: number // fnv1a() of the contents, 0 for the first appvar
+  file: Uint8Array // .8xv file
+}
+
+// lists the appvars of a book so a later conversion can skip the unchanged ones
+export interface BookManifest {
+  title: string
+  base: string
+  appVars: { name: string, size: number, hash: number }[]
+}
+
+// 32-bit FNV-1a, mirrors qrconv_fnv1a() in tools/qrconv/util.h
+export function fnv1a(data: Uint8Array): number {
+  let hash = 0x811c9dc5
+  for (let i = 0; i < data.length; i++) {
+    hash = Math.imul(hash ^ data[i], 16777619)
+  }
+  return hash >>> 0
+}
+
+// appvar base name derived from the title, so converting a book again gives
+// the same names, mirrors make_base_name() in tools/qrconv/qrconv.c
+export function makeBaseName(title: string): string {
+  let hash = 0x811c9dc5
+  for (const byte of new TextEncoder().encode(title)) {
+    hash = Math.imul(hash ^ byte, 16777619) >>> 0
+  }
+  let base = NAME_ALPHABET[hash % 26]
+  hash = Math.floor(hash / 26)
+  for (let i = 1; i < 6; i++) {
+    hash = (Math.imul(hash, 16777619) + i) >>> 0
+    base += NAME_ALPHABET[(hash >>> 8) % 36]
+  }
+  return base
+}
+
+// The first appvar is <base>00, the calculator opens the book by it. The others
+// are named after their hash so that an unchanged chunk keeps its appvar, see
+// chunk_hash_name() in src/quickrdr.c.
+export function chunkName(base: string, index: number, hash: number): string {
+  if (index == 0) {
+    return base + '00'
+  }
+  let name = base.slice(0, 3)
+  for (let i = 0; i < 5; i++) {
+    name += NAME_ALPHABET[hash % 26]
+    hash = Math.floor(hash / 26)
+  }
+  return name
+}
+
+// chunks come from QuickRDRFile.asChunks(), one appvar each
+export function convertChunksToAppVars(chunks: Uint8Array[], base: string): AppVar[] {
+  if (base.length > 6) {
     throw new Error('Name length exceeds 6 characters')
   }
-  const sections = Math.ceil(data.byteLength / MAX_APPVAR_SIZE)
-  const files = []
-  for (let i = 0; i < sections; i++) {
-    const start = i * MAX_APPVAR_SIZE
-    const end = Math.min(start + MAX_APPVAR_SIZE, data.byteLength)
-    const sectionData = data.slice(start, end)
-    const fileName = name + i.toString().padStart(2, '0')
+  const appVars = []
+  for (let i = 0; i < chunks.length; i++) {
+    const sectionData = chunks[i]
+    const hash = i == 0 ? 0 : fnv1a(sectionData)
+    const fileName = chunkName(base, i, hash)
     const entry = convertDataToAppVarEntry(sectionData, fileName)
 
     const buffer = new Uint8Array(55 + entry.byteLength + 2)
@@ -27,9 +81,17 @@ export function convertDataToAppVars(data: Uint8Array, name: string): Uint8Array
     }
     checksum = checksum & 0xffff
     dataView.setUint16(55 + entry.byteLength, checksum, true)
-    files.push(buffer)
+    appVars.push({ name: fileName, hash, file: buffer })
+  }
+  return appVars
+}
+
+export function makeManifest(title: string, base: string, chunks: Uint8Array[], appVars: AppVar[]): BookManifest {
+  return {
+    title,
+    base,
+    appVars: appVars.map((appVar, i) => ({ name: appVar.name, size: chunks[i].byteLength, hash: appVar.hash })),
   }
-  return files
 }
 
 export function convertDataToAppVarEntry(data: Uint8Array, name: string): Uint8Array {
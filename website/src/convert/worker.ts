@@ -0,0 +1,40 @@
+import { convertStreamToQuickRDR, type ConvertProgress } from './convert'
+import type { BookReport } from './report'
+import { font, grayFont } from './font'
+import { convertChunksToAppVars, makeBaseName, makeManifest, type AppVar, type BookManifest } from './ti'
+
+export interface ConvertRequest {
+  file: Blob
+  title: string
+  grayscale: boolean // anti-aliased 2bpp glyphs
+  compressed: boolean // Huffman-coded glyph stream
+}
+
+export type ConvertResponse =
+  | { type: 'progress'; progress: ConvertProgress }
+  | { type: 'done'; appVars: AppVar[]; manifest: BookManifest; report: BookReport }
+  | { type: 'error'; message: string }
+
+function post(message: ConvertResponse, transfer: Transferable[] = []) {
+  self.postMessage(message, { transfer })
+}
+
+self.onmessage = async (event: MessageEvent<ConvertRequest>) => {
+  const { file, title, grayscale, compressed } = event.data
+  try {
+    const { chunks, report } = await convertStreamToQuickRDR({
+      open: () => file.stream(),
+      size: file.size,
+      title,
+      font: grayscale ? grayFont : font,
+      coded: compressed,
+      onProgress: (progress) => post({ type: 'progress', progress }),
+    })
+    const baseName = makeBaseName(title)
+    const appVars = convertChunksToAppVars(chunks, baseName)
+    const manifest = makeManifest(title, baseName, chunks, appVars)
+    post({ type: 'done', appVars, manifest, report }, appVars.map((appVar) => appVar.file.buffer))
+  } catch (e) {
+    post({ type: 'error', message: e instanceof Error ? e.message : String(e) })
+  }
+}
@@ -0,0 +1,23 @@
+import { fileURLToPath } from 'node:url'
+import { mergeConfig, defineConfig } from 'vitest/config'
+import viteConfig from './vite.config'
+
+export default mergeConfig(
+  viteConfig,
+  defineConfig({
+    test: {
+      environment: 'node',
+      root: fileURLToPath(new URL('./', import.meta.url)),
+      benchmark: {
+        include: ['bench/**/*.bench.ts'],
+      },
+      // lets the benchmarks collect garbage between stages
+      pool: 'forks',
+      poolOptions: {
+        forks: {
+          execArgv: ['--expose-gc'],
+        },
+      },
+    },
+  }),
+)